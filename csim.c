@@ -1,7 +1,9 @@
 /* 
  * csim.c - A cache simulator that can replay traces from Valgrind
  *     and output statistics such as number of hits, misses, and
- *     evictions.  The replacement policy is LRU.
+ *     evictions.  The replacement policy is LRU unless --policy picks
+ *     LIP, BIP or DIP (LRU with other insertion positions) or the PC-based
+ *     SHiP and Hawkeye.
  *
  * Implementation and assumptions:
  *  1. Each load/store can cause at most one cache miss plus a possible eviction.
@@ -9,6 +11,9 @@
  *  3. Data modify (M) is treated as a load followed by a store to the same
  *  address. Hence, an M operation can result in two cache hits, or a miss and a
  *  hit plus a possible eviction.
+ *  4. Beyond lackey's L/S/M, traces may carry non-temporal loads (X) and
+ *  stores (N), which never allocate a line (an N also invalidates a line it
+ *  hits), clflush (F), clwb (W) and a global invalidate (G, no address).
  *
  * The function printSummary() is given to print output.
  * Please use this function to print the number of hits, misses and evictions.
@@ -25,6 +30,28 @@
 #include <string.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/file.h>
+#include <sys/resource.h>
+#include <sys/utsname.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
 
 /****************************************************************************/
 /***** DO NOT MODIFY THESE VARIABLE NAMES ***********************************/
@@ -41,9 +68,9 @@ int B; /* block size (bytes) B = 2^b */
 int S; /* number of sets S = 2^s In C, you can use the left shift operator */
 
 /* Counters used to record cache statistics */
-int hit_cnt = 0;
-int miss_cnt = 0;
-int evict_cnt = 0;
+unsigned long long hit_cnt = 0;
+unsigned long long miss_cnt = 0;
+unsigned long long evict_cnt = 0;
 /*****************************************************************************/
 
 
@@ -52,12 +79,38 @@ int evict_cnt = 0;
  */
 typedef unsigned long long int mem_addr_t;
 
+/* Record types a trace may contain (see 4. above) */
+#define RECORD_OPS "LSMXNFWG"
+
+static inline int isRecordOp(char op) {
+    return op && strchr(RECORD_OPS, op);
+}
+
+/*
+ * parseOperands - Read the "<addr>,<len>" of the lackey record in buf.
+ *   G has no operands, so its address and size are 0.
+ */
+static inline void parseOperands(char* buf, mem_addr_t* address,
+                                 unsigned int* len) {
+    *address = 0;
+    *len = 0;
+    if (buf[1] != 'G')
+        sscanf(buf + 3, "%llx,%u", address, len);
+}
+
 /* Type: Cache line
+ * A line is valid only if it was filled in the current cache_epoch, so a
+ * global invalidate just starts a new epoch.
  */
 typedef struct cache_line {
     char valid;
+    unsigned char rrpv;   /* SHiP/Hawkeye: re-reference prediction */
+    char reused;          /* SHiP: hit since the fill */
+    unsigned char owner;  /* --corun: source that filled the line */
+    unsigned short sig;   /* SHiP/Hawkeye: PC signature of the fill */
     mem_addr_t tag;
-    int count;
+    long long count;      /* recency stamp; LIP/BIP fills go below zero */
+    unsigned int epoch;   /* cache_epoch when the line was filled */
 } cache_line_t;
 
 typedef cache_line_t* cache_set_t;
@@ -66,6 +119,635 @@ typedef cache_set_t* cache_t;
 
 /* The cache we are simulating */
 cache_t cache;
+unsigned int cache_epoch = 0; /* bumped by each global invalidate */
+
+/* Cache control counters */
+long long bypass_cnt = 0;     /* non-temporal misses, not allocated */
+long long invalidate_cnt = 0; /* lines dropped by N and F records */
+long long flush_cnt = 0;      /* F and W records */
+long long global_inval_cnt = 0; /* G records */
+
+/*
+ * lineValid - Whether line holds data in the current epoch.
+ */
+static inline int lineValid(cache_line_t* line) {
+    return line->valid == '1' && line->epoch == cache_epoch;
+}
+
+/* Type: Outcome of the most recent accessData() call
+ * Filled in on every access so loggers and analyses can see what happened
+ * without repeating the lookup.
+ */
+#define ACCESS_HIT   1
+#define ACCESS_MISS  2
+#define ACCESS_EVICT 4   /* set together with ACCESS_MISS */
+#define ACCESS_BYPASS 8  /* non-temporal: nothing was allocated */
+
+typedef struct access_info {
+    mem_addr_t set;
+    int way;
+    int result;
+    mem_addr_t victim_tag;  /* tag of the evicted line, with ACCESS_EVICT */
+} access_info_t;
+
+access_info_t last_access;
+
+/* Replacement policy (--policy). LIP, BIP and DIP keep LRU's recency
+ * stamps and only change where a fill is inserted. SHiP and Hawkeye are
+ * RRIP policies that pick the insertion position from the PC of the
+ * access. Their tables are fixed size: the SHCT is 16 KiB and the Hawkeye
+ * predictor 2 KiB, which stay in the host's cache; the OPTgen sampler
+ * holds 25 bytes per history slot, 25*8E*64 bytes (200 KiB at E=16). */
+enum { POLICY_LRU, POLICY_LIP, POLICY_BIP, POLICY_DIP, POLICY_SHIP,
+       POLICY_HAWKEYE, POLICIES };
+const char* policy_names[POLICIES] = { "lru", "lip", "bip", "dip", "ship",
+                                       "hawkeye" };
+int policy = POLICY_LRU;
+
+/* Name of the replacement policy, as reported in results and stats */
+const char* policy_name = "lru";
+
+#define BIP_EPSILON 32        /* BIP: one fill in 32 goes to MRU */
+#define DIP_LEADERS 32        /* DIP: leader sets for each of LRU and BIP */
+#define PSEL_MAX 1023         /* DIP: 10-bit policy selector */
+long long bip_fills = 0;
+int psel = PSEL_MAX / 2;      /* above half: followers use BIP */
+
+#define SIG_SIZE 16384        /* PC signatures (SHiP SHCT entries) */
+#define SHIP_RRPV_MAX 3       /* 2-bit RRPV */
+#define SHCT_MAX 7            /* 3-bit signature counters */
+unsigned char shct[SIG_SIZE]; /* SHiP: reuse counter per signature */
+
+#define HAWK_RRPV_MAX 7       /* 3-bit RRPV; 7 marks cache-averse lines */
+#define HAWK_PRED_SIZE 2048   /* Hawkeye predictor entries */
+#define HAWK_PRED_MAX 7       /* 3-bit counters; >= 4 is cache-friendly */
+#define HAWK_SAMPLED_SETS 64  /* sets OPTgen watches */
+#define HAWK_HISTORY 8        /* OPTgen history, in multiples of E */
+
+/* Type: OPTgen sampler of one set
+ * Replays the set's accesses against Belady's OPT over the last
+ * HAWK_HISTORY*E accesses: occupancy[t] counts the blocks OPT keeps
+ * cached across access t, and a reuse is an OPT hit if every slot since
+ * the previous access still has room. */
+typedef struct optgen_entry {
+    mem_addr_t tag;
+    long long last;       /* time of the previous access, -1 if unused */
+    unsigned short sig;   /* its PC signature */
+} optgen_entry_t;
+
+typedef struct optgen {
+    unsigned char* occupancy; /* HAWK_HISTORY*E slots, circular */
+    optgen_entry_t* blocks;   /* HAWK_HISTORY*E most recent blocks */
+    long long now;
+} optgen_t;
+
+unsigned char hawk_pred[HAWK_PRED_SIZE]; /* Hawkeye: per-PC predictor */
+optgen_t* optgen = NULL;      /* one per sampled set */
+int optgen_shift = 0;         /* sampled sets are multiples of 2^shift */
+int need_pc = 0;              /* the policy uses cur_pc */
+
+/* Way partitioning (--cat), as Intel CAT does it: an access hits in any
+ * way but fills only the ways of its tenant's mask. An access belongs to
+ * the first tenant whose selector (thread, trace source or address range)
+ * matches, and otherwise to other_tenant. */
+#define MAX_TENANTS 16
+
+typedef struct tenant {
+    unsigned long long mask;  /* ways the tenant may fill */
+    int thread;               /* selector: thread, or -1 */
+    int source;               /* selector: --corun source, or -1 */
+    mem_addr_t lo, hi;        /* selector: address range, if hi > lo */
+    long long hits, misses, evicts;
+} tenant_t;
+
+tenant_t tenants[MAX_TENANTS];
+int n_tenants = 0;
+tenant_t other_tenant = { ~0ULL, -1, -1, 0, 0, 0, 0, 0 };
+int partitioned = 0;          /* any --cat given */
+int cat_sweep = 0;            /* --cat-sweep */
+unsigned long long access_mask = ~0ULL; /* ways the access may fill */
+
+/*
+ * wayMask - The mask of ways 0 to n-1; shifting by 64 or more would be
+ *   undefined.
+ */
+static inline unsigned long long wayMask(int n) {
+    return n >= 64 ? ~0ULL : (1ULL << n) - 1;
+}
+
+/*
+ * wayAllowed - Whether the current access may fill way n. Only runs
+ *   without --cat have more than 64 ways.
+ */
+static inline int wayAllowed(int n) {
+    return n >= 64 || (access_mask >> n & 1);
+}
+
+/* Checkpoint/restore options */
+char* save_state_file = NULL; /* --save-state: file to write cache state to */
+long long save_at = -1;       /* --save-at: record after which state is saved */
+char* restore_file = NULL;    /* --restore: file to read cache state from */
+long long skip_to = -1;       /* --skip-to: first trace record to simulate */
+long long checkpoint_every = 0; /* --checkpoint-every: records between saves */
+
+/* Trace windowing options */
+long long rec_limit = -1;     /* --limit: number of records to simulate */
+int use_index = 0;            /* --index: seek with the <trace>.idx sidecar */
+
+/* Ingest filters: records they drop are counted but never simulated */
+#define MAX_RANGES 16
+
+char* filter_ops = NULL;      /* --ops: record types to keep, e.g. "SM" */
+mem_addr_t range_lo[MAX_RANGES], range_hi[MAX_RANGES]; /* --addr-range */
+int n_ranges = 0;
+char* filter_out = NULL;      /* --filter-out: write kept records here */
+FILE* filter_fp = NULL;
+mem_addr_t filter_pc = 0;     /* pc of the last I line written there */
+long long filtered_cnt = 0;   /* records dropped by the filters */
+int filtering = 0;            /* any of the above set */
+
+/* Type: Trace index file header
+ * The header is followed by one seek point per INDEX_STRIDE records:
+ * entry i is the last place at or before record i*INDEX_STRIDE where
+ * reading can start. In a text trace that is the line of the record
+ * itself; a binary reader decodes in batches, so there it is the batch
+ * boundary before the record, with the reader's state at that boundary.
+ * The trace's size and mtime detect a stale index, and the format an
+ * index of the same file read as another format.
+ */
+#define INDEX_MAGIC "CSIMIDX"
+#define INDEX_VERSION 3       /* 3: binary formats and reader state */
+#define INDEX_STRIDE 65536
+
+typedef struct index_header {
+    char magic[8];
+    int version;
+    int stride;           /* records between seek points */
+    long long trace_size;
+    long long trace_mtime_ns;
+    long long n_entries;
+    int format;           /* --trace-format the index was built for */
+} index_header_t;
+
+typedef struct seek_point {
+    long long offset;     /* byte offset to read from */
+    long long rec;        /* number of the first record read from there */
+    mem_addr_t pc;        /* binary reader state at offset */
+    unsigned long long timestamp;
+    int thread;
+} seek_point_t;
+
+/* Parsed-trace cache options */
+char* trace_cache_dir = NULL; /* --trace-cache: directory of decoded traces */
+long long trace_cache_max = -1; /* --trace-cache-max: size limit in bytes */
+
+/* Type: Decoded trace record
+ * A cached trace is a header followed by one of these per L/S/M line.
+ */
+typedef struct trace_rec {
+    mem_addr_t addr;
+    unsigned int len;
+    char op;
+} trace_rec_t;
+
+/* Type: Cached trace file header
+ * A cached copy is only used if the trace still has the recorded size,
+ * mtime and content fingerprint.
+ */
+#define TRACE_CACHE_MAGIC "CSIMTRC"
+#define TRACE_CACHE_VERSION 2 /* 2: all RECORD_OPS are records */
+#define TRACE_CACHE_SUFFIX ".ctrace"
+
+typedef struct trace_cache_header {
+    char magic[8];
+    int version;
+    long long trace_size;
+    long long trace_mtime_ns;
+    unsigned long long fingerprint;
+    long long n_recs;
+} trace_cache_header_t;
+
+/* Trace formats (--trace-format). Lackey text is read line by line and
+ * keeps byte offsets for --index and checkpoints; the binary formats are
+ * decoded in batches and located by record number. A raw record is a
+ * fixed 8 bytes, so --skip seeks straight to it; drmemtrace and ChampSim
+ * records vary in size and seek with --index. */
+enum { FORMAT_LACKEY, FORMAT_DRMEMTRACE, FORMAT_CHAMPSIM, FORMAT_RAW,
+       FORMATS };
+const char* format_names[FORMATS] = { "lackey", "drmemtrace", "champsim",
+                                      "raw" };
+#define READ_BATCH 1024       /* records decoded per reader call */
+
+/* drmemtrace trace_entry_t types used here (see DynamoRIO's trace_type_t) */
+#define DRMEM_READ 0
+#define DRMEM_WRITE 1
+#define DRMEM_INSTR 10        /* through DRMEM_INSTR_RETURN: instructions */
+#define DRMEM_INSTR_RETURN 16
+#define DRMEM_DATA_FLUSH 20
+#define DRMEM_THREAD 22
+#define DRMEM_MARKER 28
+#define DRMEM_MARKER_TIMESTAMP 2
+#define DRMEM_ENTRY 12        /* packed: u16 type, u16 size, u64 addr */
+
+/* ChampSim input_instr: ip, branch info and registers (16 bytes), then
+ * 2 destination and 4 source memory addresses; 0 means unused */
+#define CHAMPSIM_ENTRY 64
+#define CHAMPSIM_DST 16
+#define CHAMPSIM_SRC 32
+
+#define RAW_ENTRY 8           /* a little-endian u64 address */
+
+/* Type: An access decoded by a trace reader */
+typedef struct access_rec {
+    mem_addr_t addr;
+    mem_addr_t pc;        /* instruction address, 0 if unknown */
+    unsigned long long time; /* last timestamp seen, 0 if none */
+    unsigned int len;
+    int thread;           /* -1 if unknown */
+    char op;              /* one of RECORD_OPS */
+} access_rec_t;
+
+/* Type: State of a binary trace reader. decode() fills up to max records
+ * and returns how many, 0 at the end of the trace. */
+typedef struct trace_reader {
+    FILE* fp;
+    int (*decode)(struct trace_reader* rd, access_rec_t* recs, int max);
+    mem_addr_t pc;        /* last instruction seen */
+    int thread;
+    unsigned long long timestamp; /* last timestamp marker */
+    access_rec_t held[6]; /* ChampSim: records of an instruction that did */
+    int held_pos, n_held; /* not fit in the last batch */
+} trace_reader_t;
+
+int trace_format = FORMAT_LACKEY; /* --trace-format */
+mem_addr_t cur_pc = 0;        /* pc of the record being simulated */
+int cur_thread = -1;          /* thread of the record being simulated */
+FILE* progress_fp = NULL;     /* binary trace, for byte-based progress */
+
+/* Co-run (--corun): several traces, the sources, share the cache. Each
+ * is read through its own reader into a buffer of READ_BATCH records, so
+ * memory stays bounded however long the traces are. Sources take turns
+ * of quantum records, or go in timestamp order. */
+#define MAX_SOURCES 16
+enum { INTERLEAVE_QUANTUM, INTERLEAVE_TIME };
+
+typedef struct corun_src {
+    char* trace_fn;
+    trace_reader_t rd;
+    access_rec_t* buf;
+    int pos, n;           /* next and number of buffered records */
+    int done;             /* its trace has ended */
+    long long quantum;    /* records per turn */
+    long long left;       /* records left in the current turn */
+    long long issued;     /* records replayed */
+    long long hits, misses, evicts;
+} corun_src_t;
+
+char* source_files[MAX_SOURCES]; /* [0] is -t, the rest --corun */
+int n_sources = 1;
+long long quanta[MAX_SOURCES];   /* --interleave rr:Q or rate:R0,R1,... */
+int interleave = INTERLEAVE_QUANTUM;
+corun_src_t* sources = NULL;
+long long* cross_evict = NULL;   /* [owner * n_sources + evictor] */
+int cur_source = 0;              /* source of the record being simulated */
+
+/* Result memoization options */
+char* results_store = NULL;   /* --results-store: append-only results file */
+
+/* Self-profiling (--profile): ticks spent in each stage of a run */
+enum { PROF_IO, PROF_PARSE, PROF_ACCESS, PROF_OUTPUT, PROF_OTHER,
+       PROF_STAGES };
+int profiling = 0;
+unsigned long long prof_ticks[PROF_STAGES];
+unsigned long long prof_last;          /* tick of the last stage boundary */
+long long prof_records = 0;            /* records simulated */
+
+/* Host performance counters (--perf-counters) */
+enum { PERF_CYCLES, PERF_INSTRUCTIONS, PERF_LLC_MISSES, PERF_DTLB_MISSES,
+       PERF_BRANCH_MISSES, PERF_EVENTS };
+int perf_counters = 0;
+int perf_fd[PERF_EVENTS];
+int perf_leader = -1;              /* fd of the group's first event */
+long long perf_val[PERF_EVENTS];   /* -1 where an event is unavailable */
+double perf_scale = 1;             /* time enabled / time counted */
+
+/* Benchmark and synthetic trace options */
+int bench_mode = 0;           /* --bench: run the simulation benchmarks */
+long long bench_accesses = 2000000; /* --bench-accesses: records per run */
+char* bench_out = NULL;       /* --bench-out: append JSON results here */
+int bench_reps = 5;           /* --bench-reps: repetitions per benchmark */
+char* bench_baseline = NULL;  /* --bench-baseline: stored baseline rates */
+int bench_save_baseline = 0;  /* --bench-save-baseline: record this run */
+double bench_threshold = 5.0; /* --bench-threshold: regression percent */
+char* gen_kind = NULL;        /* --gen: write a synthetic trace to stdout */
+long long gen_length = 1000000; /* --gen-length: records to generate */
+unsigned long long seed = 1;  /* --seed: generator seed */
+
+/* Synthetic access patterns */
+enum { GEN_SEQ, GEN_STRIDE, GEN_RANDOM, GEN_ZIPF, GEN_CHASE, GEN_TRANSPOSE,
+       GEN_KINDS };
+const char* gen_names[GEN_KINDS] = { "seq", "stride", "random", "zipf",
+                                     "chase", "transpose" };
+
+/* Per-access event log (--event-log) */
+char* event_log = NULL;       /* --event-log: file to write events to */
+int event_binary = 0;         /* --event-format bin: fixed-size records */
+FILE* event_fp = NULL;
+int observing = 0;            /* per-access hooks (logging, analyses) on */
+
+/* Type: Binary event log record (--event-format bin) */
+typedef struct event_rec {
+    mem_addr_t addr;
+    mem_addr_t victim_tag;  /* 0 unless result has ACCESS_EVICT */
+    unsigned int set;
+    char op;
+    char result;          /* ACCESS_* bits */
+    short pad;
+} event_rec_t;
+
+/* Structured statistics output (--stats-out) */
+char* stats_out = NULL;       /* --stats-out: file to write statistics to */
+int stats_csv = 0;            /* --format csv instead of json */
+
+/* Type: One statistics field
+ * Fields are collected in schema order and then written as nested JSON
+ * objects (one per section) or as a CSV header and row of section_key
+ * columns, so both formats always carry the same fields. Both start with
+ * the schema version.
+ */
+#define MAX_STATS 256
+#define STATS_SCHEMA "csim-stats/2"
+
+typedef struct stat_field {
+    const char* section;
+    const char* key;
+    char value[PATH_MAX];
+    int is_string;        /* 1 for strings, 2 for a missing (null) string */
+} stat_field_t;
+
+stat_field_t stats[MAX_STATS];
+int n_stats = 0;
+
+/* Asynchronous requests to the replay loop, set from signal handlers and
+ * checked once per record */
+#define EVENT_PROGRESS 1      /* the --progress timer fired */
+#define EVENT_DUMP     2      /* SIGUSR1: write a statistics snapshot */
+volatile sig_atomic_t replay_events = 0;
+
+/* On-demand statistics snapshots (SIGUSR1) */
+char* dump_file = NULL;       /* --dump-file: where snapshots are written */
+long long dump_rec = 0;       /* rec_cnt at the previous snapshot */
+unsigned long long dump_hits = 0, dump_misses = 0, dump_evicts = 0;
+struct timespec dump_ts;      /* time of the previous snapshot */
+
+/* Live progress reporting (--progress) */
+int progress_secs = 0;        /* --progress: seconds between reports */
+int progress_bytes;           /* positions below are bytes, else records */
+long long progress_start;     /* position where this replay started */
+long long progress_end;       /* position where it will stop */
+long long progress_start_rec; /* rec_cnt where this replay started */
+struct timespec progress_t0;
+
+/* Interval statistics (--interval): analyses report every interval_len
+ * records */
+long long interval_len = 0;
+long long next_interval = -1;
+long long interval_cnt = 0;   /* intervals completed */
+
+/* Working-set estimation (--footprint) with HyperLogLog sketches of the
+ * distinct blocks and pages touched, per interval and overall */
+#define HLL_P 12              /* 4096 registers: ~1.6% standard error */
+#define HLL_REGS (1 << HLL_P)
+
+typedef struct hll {
+    unsigned char reg[HLL_REGS];
+} hll_t;
+
+int footprint = 0;            /* --footprint */
+int page_bits = 12;           /* --page-bits: page size for the estimate */
+hll_t fp_blocks, fp_pages;    /* current interval */
+hll_t fp_all_blocks, fp_all_pages; /* whole run */
+
+/* Line lifetime and dead-block analysis (--lifetimes). Time is measured
+ * in accesses. A generation runs from a fill to the eviction (or
+ * invalidation) of the line: it is live until its last hit and dead from
+ * then until the eviction. */
+#define LIFE_BUCKETS 40       /* log2 histogram buckets */
+#define REGION_SLOTS 4096     /* regions tracked before folding into one */
+
+typedef struct line_life {
+    long long fill;       /* access time of the fill, -1 if unknown */
+    long long last_use;   /* access time of the fill or the last hit */
+    long long hits;
+} line_life_t;
+
+typedef struct life_stats {
+    long long fills;      /* generations ended by an eviction or
+                             invalidation */
+    long long dead_fills; /* of those, never hit after the fill */
+    long long dead_time;  /* sum of dead times */
+} life_stats_t;
+
+typedef struct region_life {
+    mem_addr_t region;    /* address >> region_bits, + 1 (0 marks empty) */
+    life_stats_t st;
+    long long hist_hits[LIFE_BUCKETS], hist_live[LIFE_BUCKETS],
+              hist_dead[LIFE_BUCKETS];
+} region_life_t;
+
+int lifetimes = 0;            /* --lifetimes */
+int region_bits = 20;         /* --region-bits: region size for reports */
+line_life_t* life = NULL;     /* S*E entries, indexed like the cache lines */
+life_stats_t* set_life = NULL; /* per set */
+region_life_t region_life[REGION_SLOTS];
+region_life_t other_life;     /* regions beyond REGION_SLOTS */
+region_life_t all_life;       /* whole cache: histograms only */
+
+/* Access-pattern classification (--classify). Accesses are grouped into
+ * streams by region; a stream whose block stride repeats is sequential
+ * (+-1 block) or strided, otherwise irregular. */
+enum { CLASS_SEQUENTIAL, CLASS_STRIDED, CLASS_IRREGULAR, CLASSES };
+const char* class_names[CLASSES] = { "sequential", "strided", "irregular" };
+#define STREAM_SLOTS 4096     /* streams tracked before folding into one */
+
+typedef struct stream {
+    mem_addr_t region;    /* address >> region_bits, + 1 (0 marks empty) */
+    mem_addr_t last_block;
+    long long stride;     /* last block delta */
+    int conf;             /* times in a row the stride repeated (max 3) */
+    int cls;              /* class of the stream's last access */
+    long long accesses[CLASSES];
+    long long misses[CLASSES];
+} stream_t;
+
+int classify = 0;             /* --classify */
+stream_t streams[STREAM_SLOTS];
+stream_t other_stream;        /* streams beyond STREAM_SLOTS */
+long long class_accesses[CLASSES], class_misses[CLASSES];
+
+/* Differential replay (--diff). Run A replays -t and run B the --diff
+ * trace, in lockstep, each with its own cache and counters swapped in
+ * around its accesses; misses of both are kept per set, region and
+ * interval so the report can rank where the runs differ. */
+#define DIFF_INTERVAL (1 << 20) /* records per interval without --interval */
+
+typedef struct diff_cnt {
+    long long accesses[2];
+    long long misses[2];
+} diff_cnt_t;
+
+typedef struct diff_region {
+    mem_addr_t region;    /* address >> region_bits, + 1 (0 marks empty) */
+    diff_cnt_t cnt;
+} diff_region_t;
+
+typedef struct diff_run {
+    char* trace_fn;
+    trace_reader_t rd;    /* reader of --trace-format */
+    access_rec_t* buf;    /* its last batch */
+    int pos, n;           /* next and number of records in buf */
+    cache_t cache;
+    unsigned int epoch;
+    unsigned long long hits, misses, evicts;
+    long long recs;       /* records read, including skipped ones */
+} diff_run_t;
+
+char* diff_file = NULL;       /* --diff: trace or stats file to compare */
+diff_cnt_t* diff_sets = NULL;
+diff_region_t diff_regions[REGION_SLOTS];
+diff_cnt_t diff_other;        /* regions beyond REGION_SLOTS */
+diff_cnt_t* diff_intervals = NULL;
+long long n_diff_intervals = 0;
+
+/* Type: LRU stack of blocks
+ * Gives the reuse (stack) distance of each access: the number of distinct
+ * blocks touched since the previous access to the same block. Each
+ * block's last access marks a time slot; a Fenwick tree counts the marks
+ * between two slots. Slots are renumbered when they run out, so memory is
+ * proportional to the number of distinct blocks, not the trace length.
+ */
+typedef struct lru_stack {
+    int* bit;             /* Fenwick tree over slots, 1-based */
+    char* mark;           /* slot holds some block's last access */
+    mem_addr_t* slot_block; /* block whose last access is in the slot */
+    long long cap;        /* slots (a power of two) */
+    long long now;        /* next free slot */
+    long long distinct;   /* blocks seen */
+    mem_addr_t* keys;     /* hash map: block + 1 (0 marks empty) */
+    long long* slots;     /* hash map: the block's slot */
+    long long map_cap;
+} lru_stack_t;
+
+/* Reuse-distance profile (--reuse-profile), the input of --gen-profile.
+ * Cold (first) accesses are classified by their block delta from the
+ * previous cold access, which is what a generator needs to lay out new
+ * data the way the program did. */
+#define MAX_STRIDES 64
+#define PROFILE_MAGIC "csim-reuse-profile"
+#define PROFILE_VERSION 1
+
+char* reuse_profile = NULL;   /* --reuse-profile: file to write it to */
+char* gen_profile = NULL;     /* --gen-profile: generate a trace from one */
+lru_stack_t reuse_stack;
+long long reuse_hist[LIFE_BUCKETS]; /* log2 buckets of reuse distance */
+long long reuse_cold = 0;
+long long op_counts[3];       /* L, S, M records */
+long long len_counts[17];     /* access sizes 0..16 */
+long long cold_class[CLASSES]; /* how cold blocks follow each other */
+long long stride_val[MAX_STRIDES], stride_cnt[MAX_STRIDES];
+int n_strides = 0;
+mem_addr_t last_cold = 0;
+long long last_cold_delta = 0;
+
+/* Background checkpoint writer (0 if none is running) */
+pid_t checkpoint_pid = 0;
+long long next_checkpoint = -1; /* record at which the next save starts */
+
+/* Number of data records (L/S/M lines) consumed from the trace so far */
+long long rec_cnt = 0;
+
+/* Number of accessData() calls made by this run (excluding restored ones) */
+long long replay_accesses = 0;
+long long restored_accesses = 0;  /* hits + misses loaded by --restore */
+
+/* When the run started (monotonic clock) */
+struct timespec run_start;
+
+/* Type: Checkpoint file header
+ * The header is followed by the S*E cache lines, set by set, exactly as
+ * they are laid out in memory, so a restore is a single read. The trace's
+ * size, mtime and content fingerprint, as the trace cache records them,
+ * keep a checkpoint from being resumed on another trace.
+ */
+#define CKPT_MAGIC "CSIMCKP"
+#define CKPT_VERSION 5       /* 3: trace identity and format,
+                                4: 64-bit hit, miss and eviction counts,
+                                5: 64-bit recency stamps */
+
+typedef struct ckpt_header {
+    char magic[8];
+    int version;
+    int s, E, b;
+    unsigned long long hit_cnt, miss_cnt, evict_cnt;
+    unsigned int epoch;   /* cache_epoch */
+    long long rec;        /* records consumed when the state was saved */
+    long long offset;     /* trace byte offset of the next record */
+    long long bypass_cnt, invalidate_cnt, flush_cnt, global_inval_cnt;
+    long long trace_size;
+    long long trace_mtime_ns;
+    unsigned long long fingerprint;
+    int format;           /* --trace-format the offset is in */
+} ckpt_header_t;
+
+/*
+ * hash64 - Mix the bits of x (MurmurHash3 finalizer) so every bit of the
+ *   result depends on every bit of the input.
+ */
+static inline unsigned long long hash64(unsigned long long x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    return x ^ (x >> 33);
+}
+
+/*
+ * initPolicy - Reset the state of the replacement policy: the DIP
+ *   selector halfway, the SHiP counters weakly reused, the Hawkeye
+ *   predictions weakly cache-friendly, and an empty OPTgen sampler for
+ *   HAWK_SAMPLED_SETS evenly spaced sets (HAWK_HISTORY*E slots each).
+ */
+void initPolicy() {
+    bip_fills = 0;
+    psel = PSEL_MAX / 2;
+    memset(shct, 1, sizeof(shct));
+    memset(hawk_pred, (HAWK_PRED_MAX + 1) / 2, sizeof(hawk_pred));
+    if (policy != POLICY_HAWKEYE)
+        return;
+
+    int sampled = S < HAWK_SAMPLED_SETS ? S : HAWK_SAMPLED_SETS;
+    int len = HAWK_HISTORY * E;
+    for (optgen_shift = 0; (S >> optgen_shift) > sampled; optgen_shift++)
+        ;
+    free(optgen ? optgen[0].occupancy : NULL);
+    free(optgen ? optgen[0].blocks : NULL);
+    free(optgen);
+    optgen = malloc(sampled * sizeof(optgen_t));
+    unsigned char* occupancy = calloc((size_t)sampled * len, 1);
+    optgen_entry_t* blocks = malloc((size_t)sampled * len *
+                                    sizeof(optgen_entry_t));
+    if (!optgen || !occupancy || !blocks) {
+        printf("Cannot malloc OPTgen sampler.");
+        exit(1);
+    }
+    for (int i = 0; i < sampled; i++) {
+        optgen[i].occupancy = occupancy + (size_t)i * len;
+        optgen[i].blocks = blocks + (size_t)i * len;
+        optgen[i].now = 0;
+        for (int j = 0; j < len; j++)
+            optgen[i].blocks[j].last = -1;
+    }
+}
 
 /*
  * initCache -
@@ -80,20 +762,29 @@ void initCache() {
         printf("Error: Cannot allocate cache");
         exit(1);
   }
-  // allocate space for each set
+  // all lines live in one block so the state can be saved/restored at once
+  cache_line_t* lines = malloc((size_t)S * E * sizeof(cache_line_t));
+  if (lines == NULL) {
+    printf("Cannot malloc cache_set.");
+    exit(1);
+  }
+  // point each set at its lines
   for (int i=0; i < S; i++){
-    *(cache + i) = malloc(E * sizeof(cache_line_t));
-    if (*(cache + i) == NULL) {
-      printf("Cannot malloc cache_set.");
-      exit(1);
-    }
+    *(cache + i) = lines + (size_t)i * E;
     // set tag and valid bits, update counter
     for (int j = 0; j < E; j++) {
       (*(cache + i) + j)->valid = '0';
+      (*(cache + i) + j)->rrpv = 0;
+      (*(cache + i) + j)->reused = 0;
+      (*(cache + i) + j)->owner = 0;
+      (*(cache + i) + j)->sig = 0;
       (*(cache + i) + j)->tag = 0;
       (*(cache + i) + j)->count = 0;
+      (*(cache + i) + j)->epoch = 0;
     }
   }
+  cache_epoch = 0;
+  initPolicy();
 }
 
 
@@ -101,13 +792,446 @@ void initCache() {
  *deallocate all of the sets in cache, and then cache itself
  */
 void freeCache() {
-    for (int i = 0; i < S; i++) {
-       free(*(cache + i));
-    }
+    // the sets share the block allocated for set 0
+    free(*cache);
 
     free(cache);
 }
 
+/*
+ * profTick - Read a cheap monotonic tick counter: the TSC on x86, the
+ *   monotonic clock in nanoseconds elsewhere. profReport() converts ticks
+ *   to time by comparing against the clock over the whole run.
+ */
+static inline unsigned long long profTick() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/*
+ * profStage - Charge the ticks since the last stage boundary to stage.
+ */
+static inline void profStage(int stage) {
+    unsigned long long now = profTick();
+    prof_ticks[stage] += now - prof_last;
+    prof_last = now;
+}
+
+/*
+ * hashBytes - 64-bit FNV-1a hash of len bytes, continuing from h.
+ */
+unsigned long long hashBytes(unsigned long long h, const void* data,
+                             size_t len) {
+    const unsigned char* p = data;
+
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+#define HASH_INIT 0xcbf29ce484222325ULL
+
+/*
+ * fingerprintFile - Hash the size of the file plus its first and last
+ *   64 KiB and 16 evenly spaced 4 KiB blocks. This identifies a trace's
+ *   content without reading all of a multi-gigabyte file.
+ */
+unsigned long long fingerprintFile(int fd, long long size) {
+    static char buf[65536];
+    unsigned long long h = hashBytes(HASH_INIT, &size, sizeof(size));
+    ssize_t n;
+
+    n = pread(fd, buf, sizeof(buf), 0);
+    if (n > 0)
+        h = hashBytes(h, buf, n);
+    for (long long i = 1; i <= 16; i++) {
+        n = pread(fd, buf, 4096, (off_t)(size / 17 * i));
+        if (n > 0)
+            h = hashBytes(h, buf, n);
+    }
+    if (size > (long long)sizeof(buf)) {
+        n = pread(fd, buf, sizeof(buf), (off_t)(size - sizeof(buf)));
+        if (n > 0)
+            h = hashBytes(h, buf, n);
+    }
+    return h;
+}
+
+/*
+ * hashFile - Hash the size of the file and all of its content.
+ */
+unsigned long long hashFile(int fd, long long size) {
+    static char buf[65536];
+    unsigned long long h = hashBytes(HASH_INIT, &size, sizeof(size));
+    ssize_t n;
+
+    for (off_t pos = 0; (n = pread(fd, buf, sizeof(buf), pos)) > 0;
+         pos += n)
+        h = hashBytes(h, buf, n);
+    return h;
+}
+
+/*
+ * traceIdentity - The size, mtime and content fingerprint of trace_fn, as
+ *   a checkpoint records them. They are computed once per run.
+ */
+void traceIdentity(char* trace_fn, ckpt_header_t* hdr) {
+    static ckpt_header_t id;
+    static int known = 0;
+    struct stat st;
+
+    if (!known) {
+        int fd = open(trace_fn, O_RDONLY);
+        if (fd < 0 || fstat(fd, &st) != 0) {
+            fprintf(stderr, "%s: %s\n", trace_fn, strerror(errno));
+            exit(1);
+        }
+        id.trace_size = st.st_size;
+        id.trace_mtime_ns = st.st_mtim.tv_sec * 1000000000LL
+                            + st.st_mtim.tv_nsec;
+        id.fingerprint = fingerprintFile(fd, st.st_size);
+        close(fd);
+        known = 1;
+    }
+    hdr->trace_size = id.trace_size;
+    hdr->trace_mtime_ns = id.trace_mtime_ns;
+    hdr->fingerprint = id.fingerprint;
+}
+
+/*
+ * saveState - Write the cache lines, the counters and the trace position
+ *   to a checkpoint file. The file is written under a temporary name and
+ *   renamed into place, so a reader never sees a partial checkpoint.
+ *   Returns 0 on success; errors are reported but left to the caller, which
+ *   may be a forked checkpoint writer that must not run exit handlers.
+ */
+int saveState(char* state_fn, long long rec, long long offset) {
+    char tmp_fn[PATH_MAX];
+    ckpt_header_t hdr;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, CKPT_MAGIC, sizeof(CKPT_MAGIC));
+    hdr.version = CKPT_VERSION;
+    hdr.s = s;
+    hdr.E = E;
+    hdr.b = b;
+    hdr.hit_cnt = hit_cnt;
+    hdr.miss_cnt = miss_cnt;
+    hdr.evict_cnt = evict_cnt;
+    hdr.epoch = cache_epoch;
+    hdr.rec = rec;
+    hdr.offset = offset;
+    hdr.bypass_cnt = bypass_cnt;
+    hdr.invalidate_cnt = invalidate_cnt;
+    hdr.flush_cnt = flush_cnt;
+    hdr.global_inval_cnt = global_inval_cnt;
+    traceIdentity(trace_file, &hdr);
+    hdr.format = trace_format;
+
+    snprintf(tmp_fn, sizeof(tmp_fn), "%s.tmp", state_fn);
+    FILE* state_fp = fopen(tmp_fn, "wb");
+    if (!state_fp) {
+        fprintf(stderr, "%s: %s\n", tmp_fn, strerror(errno));
+        return -1;
+    }
+    if (fwrite(&hdr, sizeof(hdr), 1, state_fp) != 1 ||
+        fwrite(*cache, sizeof(cache_line_t), (size_t)S * E, state_fp)
+            != (size_t)S * E ||
+        fflush(state_fp) != 0 || fsync(fileno(state_fp)) != 0) {
+        fprintf(stderr, "%s: %s\n", tmp_fn, strerror(errno));
+        fclose(state_fp);
+        return -1;
+    }
+    fclose(state_fp);
+    if (rename(tmp_fn, state_fn) != 0) {
+        fprintf(stderr, "%s: %s\n", state_fn, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * waitCheckpoint - Reap the background checkpoint writer. With block set,
+ *   wait for it to finish; otherwise only check whether it has.
+ *   Returns non-zero while a writer is still running.
+ */
+int waitCheckpoint(int block) {
+    int status;
+
+    if (checkpoint_pid == 0)
+        return 0;
+    if (waitpid(checkpoint_pid, &status, block ? 0 : WNOHANG) == 0)
+        return 1;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        fprintf(stderr, "Warning: background checkpoint failed\n");
+    checkpoint_pid = 0;
+    return 0;
+}
+
+/*
+ * checkpointInBackground - Save the state from a forked child, which sees
+ *   a copy-on-write snapshot of the cache, so the simulation does not
+ *   pause while the file is written. If the previous checkpoint is still
+ *   being written, this one is skipped rather than queued.
+ */
+void checkpointInBackground(char* state_fn, long long rec, long long offset) {
+    if (waitCheckpoint(0))
+        return;
+
+    // the child must not flush stdio buffers it shares with the parent
+    pid_t pid = fork();
+    if (pid == 0)
+        _exit(saveState(state_fn, rec, offset) == 0 ? 0 : 1);
+    if (pid < 0) {
+        // fall back to saving in the foreground
+        if (saveState(state_fn, rec, offset) != 0)
+            exit(1);
+        return;
+    }
+    checkpoint_pid = pid;
+}
+
+/*
+ * restoreState - Load a checkpoint written by saveState() into the
+ *   (already initialized) cache. The geometry in the file must match
+ *   -s/-E/-b. Returns the trace byte offset to continue from and stores
+ *   the number of records already consumed in *rec.
+ */
+long long restoreState(char* state_fn, long long* rec) {
+    ckpt_header_t hdr;
+    FILE* state_fp = fopen(state_fn, "rb");
+
+    if (!state_fp) {
+        fprintf(stderr, "%s: %s\n", state_fn, strerror(errno));
+        exit(1);
+    }
+    // lines of another version do not have this layout
+    if (fread(&hdr, sizeof(hdr), 1, state_fp) != 1 ||
+        memcmp(hdr.magic, CKPT_MAGIC, sizeof(CKPT_MAGIC)) != 0) {
+        fprintf(stderr, "%s: not a cache checkpoint\n", state_fn);
+        exit(1);
+    }
+    if (hdr.version != CKPT_VERSION) {
+        fprintf(stderr, "%s: checkpoint version %d, expected %d\n",
+                state_fn, hdr.version, CKPT_VERSION);
+        exit(1);
+    }
+    if (hdr.s != s || hdr.E != E || hdr.b != b) {
+        fprintf(stderr, "%s: checkpoint is for -s %d -E %d -b %d\n",
+                state_fn, hdr.s, hdr.E, hdr.b);
+        exit(1);
+    }
+    if (hdr.format != trace_format) {
+        fprintf(stderr, "%s: checkpoint is for --trace-format %s\n",
+                state_fn, hdr.format >= 0 && hdr.format < FORMATS
+                          ? format_names[hdr.format] : "?");
+        exit(1);
+    }
+    // its offset and record count are only meaningful in the same trace
+    ckpt_header_t id;
+    traceIdentity(trace_file, &id);
+    if (hdr.trace_size != id.trace_size ||
+        hdr.trace_mtime_ns != id.trace_mtime_ns ||
+        hdr.fingerprint != id.fingerprint) {
+        fprintf(stderr, "%s: checkpoint was taken from another trace, or "
+                "%s has changed\n", state_fn, trace_file);
+        exit(1);
+    }
+    // the lines are contiguous, so one read restores the whole cache
+    if (fread(*cache, sizeof(cache_line_t), (size_t)S * E, state_fp)
+            != (size_t)S * E) {
+        fprintf(stderr, "%s: truncated checkpoint\n", state_fn);
+        exit(1);
+    }
+    fclose(state_fp);
+
+    cache_epoch = hdr.epoch;
+    bypass_cnt = hdr.bypass_cnt;
+    invalidate_cnt = hdr.invalidate_cnt;
+    flush_cnt = hdr.flush_cnt;
+    global_inval_cnt = hdr.global_inval_cnt;
+    hit_cnt = hdr.hit_cnt;
+    miss_cnt = hdr.miss_cnt;
+    evict_cnt = hdr.evict_cnt;
+    *rec = hdr.rec;
+    return hdr.offset;
+}
+
+/*
+ * optgenAccess - Show an access to sampled set setNum to OPTgen and train
+ *   the Hawkeye predictor with the outcome of the block's previous access:
+ *   that access's PC is cache-friendly if OPT would have kept the block.
+ */
+void optgenAccess(mem_addr_t setNum, mem_addr_t addrTag, unsigned short sig) {
+    optgen_t* og = &optgen[setNum >> optgen_shift];
+    int len = HAWK_HISTORY * E;
+    optgen_entry_t* blk = NULL;
+    optgen_entry_t* oldest = &og->blocks[0];
+
+    og->occupancy[og->now % len] = 0;
+    for (int i = 0; i < len; i++) {
+        if (og->blocks[i].last >= 0 && og->blocks[i].tag == addrTag) {
+            blk = &og->blocks[i];
+            break;
+        }
+        if (og->blocks[i].last < oldest->last)
+            oldest = &og->blocks[i];
+    }
+
+    if (blk) {
+        int opt_hit = og->now - blk->last < len;
+        for (long long t = blk->last; opt_hit && t < og->now; t++)
+            opt_hit = og->occupancy[t % len] < E;
+        for (long long t = blk->last; opt_hit && t < og->now; t++)
+            og->occupancy[t % len]++;
+
+        unsigned char* pred = &hawk_pred[blk->sig % HAWK_PRED_SIZE];
+        if (opt_hit && *pred < HAWK_PRED_MAX)
+            (*pred)++;
+        else if (!opt_hit && *pred > 0)
+            (*pred)--;
+    } else {
+        blk = oldest;
+    }
+    blk->tag = addrTag;
+    blk->last = og->now++;
+    blk->sig = sig;
+}
+
+/*
+ * accessRRIP - accessData() for SHiP and Hawkeye. Both find victims by
+ *   re-reference prediction value (RRPV) and differ in how they predict
+ *   at insertion:
+ *   SHiP inserts at distant RRPV when the signature's counter says its
+ *   fills are never reused, and trains the counter on hits and on
+ *   evictions of unreused lines.
+ *   Hawkeye inserts lines of cache-friendly PCs at RRPV 0 (aging the
+ *   other friendly lines) and of cache-averse PCs at RRPV 7, the first to
+ *   be evicted; it learns from OPTgen on the sampled sets.
+ */
+void accessRRIP(mem_addr_t setNum, mem_addr_t addrTag) {
+    cache_line_t* lines = cache[setNum];
+    int ship = policy == POLICY_SHIP;
+    int max_rrpv = ship ? SHIP_RRPV_MAX : HAWK_RRPV_MAX;
+    unsigned short sig = hash64(cur_pc) & (SIG_SIZE - 1);
+    int friendly = 1;
+    int way = -1;
+
+    if (!ship) {
+        if ((setNum & ((1 << optgen_shift) - 1)) == 0)
+            optgenAccess(setNum, addrTag, sig);
+        friendly = hawk_pred[sig % HAWK_PRED_SIZE] > HAWK_PRED_MAX / 2;
+    }
+
+    for (int i = 0; i < E; i++) {
+        if (lineValid(&lines[i]) && lines[i].tag == addrTag) {
+            hit_cnt++;
+            last_access.way = i;
+            last_access.result = ACCESS_HIT;
+            if (ship) {
+                if (!lines[i].reused && shct[lines[i].sig] < SHCT_MAX)
+                    shct[lines[i].sig]++;
+                lines[i].reused = 1;
+                lines[i].rrpv = 0;
+            } else {
+                lines[i].rrpv = friendly ? 0 : max_rrpv;
+                lines[i].sig = sig;
+            }
+            return;
+        }
+        if (way < 0 && !lineValid(&lines[i]) && wayAllowed(i))
+            way = i;
+    }
+
+    miss_cnt++;
+    last_access.result = ACCESS_MISS;
+    if (way < 0) {
+        if (ship) {
+            // age the set until some line is predicted distant
+            while (way < 0) {
+                for (int i = 0; i < E && way < 0; i++)
+                    if (wayAllowed(i) && lines[i].rrpv == max_rrpv)
+                        way = i;
+                for (int i = 0; i < E && way < 0; i++)
+                    if (wayAllowed(i))
+                        lines[i].rrpv++;
+            }
+            if (!lines[way].reused && shct[lines[way].sig] > 0)
+                shct[lines[way].sig]--;
+        } else {
+            // an averse line if any, else the oldest friendly one, whose
+            // PC was wrong to be trusted
+            for (int i = 0; i < E; i++)
+                if (wayAllowed(i) &&
+                    (way < 0 || lines[i].rrpv > lines[way].rrpv))
+                    way = i;
+            if (lines[way].rrpv < max_rrpv &&
+                hawk_pred[lines[way].sig % HAWK_PRED_SIZE] > 0)
+                hawk_pred[lines[way].sig % HAWK_PRED_SIZE]--;
+        }
+        evict_cnt++;
+        last_access.result |= ACCESS_EVICT;
+        last_access.victim_tag = lines[way].tag;
+        if (cross_evict)
+            cross_evict[lines[way].owner * n_sources + cur_source]++;
+    }
+
+    last_access.way = way;
+    if (!ship && friendly) {
+        for (int i = 0; i < E; i++)
+            if (lineValid(&lines[i]) && lines[i].rrpv < max_rrpv - 1)
+                lines[i].rrpv++;
+    }
+    lines[way].valid = '1';
+    lines[way].epoch = cache_epoch;
+    lines[way].owner = cur_source;
+    lines[way].tag = addrTag;
+    lines[way].sig = sig;
+    lines[way].reused = 0;
+    if (ship)
+        lines[way].rrpv = shct[sig] ? max_rrpv - 1 : max_rrpv;
+    else
+        lines[way].rrpv = friendly ? 0 : max_rrpv;
+}
+
+/*
+ * insertStamp - Recency stamp for a line filled into set setNum: above
+ *   mostRecent (MRU) for LRU, below leastRecent (LRU position) for LIP,
+ *   and for BIP at LRU position except every BIP_EPSILON-th fill. Under
+ *   DIP, a miss in a leader set votes against its policy in psel, and
+ *   the other sets follow the policy that misses less.
+ */
+static inline long long insertStamp(mem_addr_t setNum, long long mostRecent,
+                                    long long leastRecent) {
+    int p = policy;
+
+    if (p == POLICY_DIP) {
+        int leaders = S >= 4 * DIP_LEADERS ? DIP_LEADERS : S / 4;
+        int stride = leaders ? S / leaders : 1;
+        if (leaders && setNum % stride == 0) {
+            p = POLICY_LRU;
+            if (psel < PSEL_MAX)
+                psel++;
+        } else if (leaders && setNum % stride == (mem_addr_t)stride / 2) {
+            p = POLICY_BIP;
+            if (psel > 0)
+                psel--;
+        } else {
+            p = psel > PSEL_MAX / 2 ? POLICY_BIP : POLICY_LRU;
+        }
+    }
+    if (p == POLICY_LIP || (p == POLICY_BIP && bip_fills++ % BIP_EPSILON))
+        return leastRecent - 1;
+    return mostRecent + 1;
+}
+
 /*
  * accessData - Access data at memory address addr.
  *   If it is already in cache, increase hit_cnt
@@ -122,17 +1246,22 @@ void accessData(mem_addr_t addr) {
     B = 2 << (b-1);
     mem_addr_t addrTag = addr / (B * S);  // the extracted tag from 
     mem_addr_t setNum = (addr / B) % S;   // the extracted set number
+    last_access.set = setNum;
+    if (policy == POLICY_SHIP || policy == POLICY_HAWKEYE) {
+        accessRRIP(setNum, addrTag);
+        return;
+    }
 
     // find the most recent and least recently used blocks
-    int mostRecent;  // keep track of the most recently used block
-    int leastRecent;  // keep track of the least recently used block
+    long long mostRecent;  // keep track of the most recently used block
+    long long leastRecent;  // keep track of the least recently used block
     mostRecent = (*(cache + setNum) + 0)->count;
-    leastRecent = (*(cache + setNum) + 0)->count;
+    leastRecent = LLONG_MAX;  // among the ways this access may fill
     for (int n = 0; n < E; n++) {
         if (mostRecent < (*(cache + setNum) + n)->count) {
             mostRecent = (*(cache + setNum) + n)->count;
         }
-        if (leastRecent > (*(cache + setNum) + n)->count) {
+        if (wayAllowed(n) && leastRecent > (*(cache + setNum) + n)->count) {
             leastRecent = (*(cache + setNum) + n)->count;
         }
     }
@@ -140,9 +1269,11 @@ void accessData(mem_addr_t addr) {
     // decide if it is possible to switch the least/most recent blocks
     for (int i = 0; i < E; i++) {
         if ((*(cache + setNum) + i)->tag == addrTag && 
-           (*(cache + setNum) + i)->valid == '1') {
+           lineValid(*(cache + setNum) + i)) {
             hit_cnt++;
             found = 1;
+            last_access.way = i;
+            last_access.result = ACCESS_HIT;
             (*(cache + setNum) + i)->count = mostRecent + 1;
             mostRecent++;
             leastRecent++;
@@ -160,13 +1291,18 @@ void accessData(mem_addr_t addr) {
 
         // if the cache has room,add the new block- update least/most recently
         for (int j = 0; j < E; j++) {
-           if ((*(cache + setNum) + j)->valid == '0') {
+           if (!lineValid(*(cache + setNum) + j) && wayAllowed(j)) {
                (*(cache + setNum) + j)->tag = addrTag;
-               (*(cache + setNum) + j)->count = mostRecent + 1;
+               (*(cache + setNum) + j)->count =
+                   insertStamp(setNum, mostRecent, leastRecent);
                mostRecent++;
                leastRecent++;
                (*(cache + setNum) + j)->valid = '1';
+               (*(cache + setNum) + j)->epoch = cache_epoch;
+               (*(cache + setNum) + j)->owner = cur_source;
                found = 1;
+               last_access.way = j;
+               last_access.result = ACCESS_MISS;
                for (int t = 0; t < E; t++){
                    if (leastRecent > (*(cache + setNum) + t)->count) {
                         leastRecent = (*(cache + setNum) + t)->count;
@@ -179,9 +1315,18 @@ void accessData(mem_addr_t addr) {
         // if the cache is full,put new block where the least recent one was
         if (!found) {
             for (int m = 0; m < E; m++) {
-                 if ((*(cache + setNum) + m)->count == leastRecent) {
+                 if ((*(cache + setNum) + m)->count == leastRecent &&
+                     wayAllowed(m)) {
+                    last_access.way = m;
+                    last_access.result = ACCESS_MISS | ACCESS_EVICT;
+                    last_access.victim_tag = (*(cache + setNum) + m)->tag;
+                    if (cross_evict)
+                        cross_evict[(*(cache + setNum) + m)->owner * n_sources
+                                    + cur_source]++;
+                    (*(cache + setNum) + m)->owner = cur_source;
                     (*(cache + setNum) + m)->tag = addrTag;
-                    (*(cache + setNum) + m)->count = mostRecent + 1;
+                    (*(cache + setNum) + m)->count =
+                        insertStamp(setNum, mostRecent, leastRecent);
                     mostRecent++;
                     leastRecent++;
                     evict_cnt++;
@@ -194,52 +1339,3682 @@ void accessData(mem_addr_t addr) {
 }
 
 /*
- * replayTrace - replays the given trace file against the cache
- * reads the input trace file line by line
- * extracts the type of each memory access : L/S/M
+ * readLE - Read an n-byte little-endian unsigned integer.
  */
-void replayTrace(char* trace_fn) {
-    char buf[1000];  // char array to hold each line in file
-    mem_addr_t address = 0;  // the address on each line
-    unsigned int len = 0;  // length of each line
-    FILE* trace_fp = fopen(trace_fn, "r");  // the initialized input file
+static inline unsigned long long readLE(const unsigned char* p, int n) {
+    unsigned long long v = 0;
 
-    // if there is an error opening the file, print error message
-    if (!trace_fp) {
-        fprintf(stderr, "%s: %s\n", trace_fn, strerror(errno));
-        exit(1);
-    }
+    while (n--)
+        v = v << 8 | p[n];
+    return v;
+}
 
-    // loop through file line by line
-    while (fgets(buf, 1000, trace_fp) != NULL) {
-        if (buf[1] == 'S' || buf[1] == 'L' || buf[1] == 'M') {
-            sscanf(buf+3, "%llx,%u", &address, &len);
+/*
+ * decodeDrmemtrace - Decode DynamoRIO drmemtrace trace_entry_t records:
+ *   reads and writes become L and S records and data flushes F records,
+ *   carrying the pc of the last instruction entry and the thread of the
+ *   last thread entry. Other entries (prefetches, markers) are skipped.
+ */
+int decodeDrmemtrace(trace_reader_t* rd, access_rec_t* recs, int max) {
+    static unsigned char ent[READ_BATCH][DRMEM_ENTRY];
+    int n = 0;
 
-            if (verbosity)
-                printf("%c %llx,%u ", buf[1], address, len);
+    while (n == 0) {
+        size_t got = fread(ent, DRMEM_ENTRY,
+                           max < READ_BATCH ? max : READ_BATCH, rd->fp);
+        if (got == 0)
+            break;
+        for (size_t i = 0; i < got; i++) {
+            int type = readLE(ent[i], 2);
+            int size = readLE(ent[i] + 2, 2);
+            mem_addr_t addr = readLE(ent[i] + 4, 8);
 
-            // call accessData function here depending on type of access
-            if (buf[1] == 'S' || buf[1] == 'L') {
-                 accessData(address);
+            if (type == DRMEM_READ || type == DRMEM_WRITE ||
+                type == DRMEM_DATA_FLUSH) {
+                recs[n].op = type == DRMEM_READ ? 'L' :
+                             type == DRMEM_WRITE ? 'S' : 'F';
+                recs[n].addr = addr;
+                recs[n].len = size;
+                recs[n].pc = rd->pc;
+                recs[n].time = rd->timestamp;
+                recs[n++].thread = rd->thread;
+            } else if (type >= DRMEM_INSTR && type <= DRMEM_INSTR_RETURN) {
+                rd->pc = addr;
+            } else if (type == DRMEM_THREAD) {
+                rd->thread = (int)addr;
+            } else if (type == DRMEM_MARKER && size == DRMEM_MARKER_TIMESTAMP) {
+                rd->timestamp = addr;
             }
+        }
+    }
+    return n;
+}
+
+/*
+ * decodeChampsim - Decode ChampSim input_instr records: each source
+ *   memory operand is a load and each destination one a store, in that
+ *   order. ChampSim does not record sizes, so accesses are 8 bytes. A
+ *   batch holds whole instructions, up to 6 records each; only a batch
+ *   too small for one holds part of an instruction over to the next.
+ */
+int decodeChampsim(trace_reader_t* rd, access_rec_t* recs, int max) {
+    static unsigned char ins[READ_BATCH / 6][CHAMPSIM_ENTRY];
+    int n = 0;
+
+    while (n < max && rd->held_pos < rd->n_held)
+        recs[n++] = rd->held[rd->held_pos++];
+    if (rd->held_pos < rd->n_held)
+        return n;
+    rd->held_pos = rd->n_held = 0;
 
-            if (buf[1] == 'M') {
-                accessData(address);
-                accessData(address);
+    for (;;) {
+        size_t want = (max - n) / 6;
+        if (want > READ_BATCH / 6)
+            want = READ_BATCH / 6;
+        if (want == 0 && n > 0)
+            break;
+        size_t got = fread(ins, CHAMPSIM_ENTRY, want ? want : 1, rd->fp);
+        if (got == 0)
+            break;
+        for (size_t i = 0; i < got; i++) {
+            rd->pc = readLE(ins[i], 8);
+            for (int k = 0; k < 6; k++) {
+                // sources first: an instruction reads before it writes
+                int off = k < 4 ? CHAMPSIM_SRC + 8 * k
+                                : CHAMPSIM_DST + 8 * (k - 4);
+                mem_addr_t addr = readLE(ins[i] + off, 8);
+                if (addr == 0)
+                    continue;
+                access_rec_t* r = n < max ? &recs[n++]
+                                          : &rd->held[rd->n_held++];
+                r->op = k < 4 ? 'L' : 'S';
+                r->addr = addr;
+                r->len = 8;
+                r->pc = rd->pc;
+                r->time = 0;
+                // no thread, as in a raw trace
+                r->thread = -1;
             }
-            if (verbosity)
-                printf("\n");
         }
     }
-
-    fclose(trace_fp);
+    return n;
+}
+
+/*
+ * decodeRaw - Decode a stream of little-endian 64-bit addresses, each an
+ *   8-byte load.
+ */
+int decodeRaw(trace_reader_t* rd, access_rec_t* recs, int max) {
+    static unsigned char raw[READ_BATCH][RAW_ENTRY];
+    size_t got = fread(raw, RAW_ENTRY, max < READ_BATCH ? max : READ_BATCH,
+                       rd->fp);
+
+    for (size_t i = 0; i < got; i++) {
+        recs[i].op = 'L';
+        recs[i].addr = readLE(raw[i], 8);
+        recs[i].len = 8;
+        recs[i].pc = 0;
+        recs[i].time = 0;
+        recs[i].thread = -1;
+    }
+    return (int)got;
+}
+
+/*
+ * decodeLackey - Decode lackey text lines, for readers that need batches
+ *   rather than byte offsets (--corun). Data accesses carry the address
+ *   of the preceding I line as their pc.
+ */
+int decodeLackey(trace_reader_t* rd, access_rec_t* recs, int max) {
+    char buf[1000];
+    int n = 0;
+
+    while (n < max && fgets(buf, sizeof(buf), rd->fp) != NULL) {
+        if (isRecordOp(buf[1])) {
+            recs[n].op = buf[1];
+            parseOperands(buf, &recs[n].addr, &recs[n].len);
+            recs[n].pc = rd->pc;
+            recs[n].time = 0;
+            recs[n++].thread = rd->thread;
+        } else if (buf[0] == 'I') {
+            rd->pc = strtoull(buf + 2, NULL, 16);
+        }
+    }
+    return n;
+}
+
+/*
+ * openReader - Open trace_fn for the reader of --trace-format.
+ */
+void openReader(trace_reader_t* rd, char* trace_fn) {
+    memset(rd, 0, sizeof(*rd));
+    rd->thread = -1;
+    rd->decode = trace_format == FORMAT_DRMEMTRACE ? decodeDrmemtrace :
+                 trace_format == FORMAT_CHAMPSIM ? decodeChampsim :
+                 trace_format == FORMAT_RAW ? decodeRaw : decodeLackey;
+    rd->fp = fopen(trace_fn, "rb");
+    if (!rd->fp) {
+        fprintf(stderr, "%s: %s\n", trace_fn, strerror(errno));
+        exit(1);
+    }
+}
+
+/*
+ * addSeekPoint - Append a copy of point to the seek points being built.
+ */
+void addSeekPoint(seek_point_t** points, size_t* cap, long long* n,
+                  seek_point_t* point) {
+    if ((size_t)*n == *cap) {
+        *cap *= 2;
+        *points = realloc(*points, *cap * sizeof(seek_point_t));
+        if (!*points) {
+            printf("Cannot malloc trace index.");
+            exit(1);
+        }
+    }
+    (*points)[(*n)++] = *point;
+}
+
+/*
+ * buildIndex - Scan the trace once and write a seek point every
+ *   INDEX_STRIDE records to idx_fn. A text trace is scanned without
+ *   parsing addresses; a binary one goes through its reader, and each
+ *   point is the last batch boundary at or before its record.
+ */
+void buildIndex(char* trace_fn, char* idx_fn, struct stat* st) {
+    char buf[1000];
+    char tmp_fn[PATH_MAX];
+    long long pos = 0;
+    long long rec = 0;
+    size_t cap = 1024;
+    index_header_t hdr;
+    seek_point_t point;
+    seek_point_t* points = malloc(cap * sizeof(seek_point_t));
+
+    if (!points) {
+        printf("Cannot malloc trace index.");
+        exit(1);
+    }
+    memset(&hdr, 0, sizeof(hdr));
+    memset(&point, 0, sizeof(point));
+    if (trace_format == FORMAT_LACKEY) {
+        FILE* trace_fp = fopen(trace_fn, "r");
+        if (!trace_fp) {
+            fprintf(stderr, "%s: %s\n", trace_fn, strerror(errno));
+            exit(1);
+        }
+        while (fgets(buf, 1000, trace_fp) != NULL) {
+            if (isRecordOp(buf[1]) && rec++ % INDEX_STRIDE == 0) {
+                point.offset = pos;
+                point.rec = rec - 1;
+                addSeekPoint(&points, &cap, &hdr.n_entries, &point);
+            }
+            pos += strlen(buf);
+        }
+        fclose(trace_fp);
+    } else {
+        static access_rec_t recs[READ_BATCH];
+        trace_reader_t rd;
+        int n;
+
+        // point holds the boundary before the batch being decoded
+        openReader(&rd, trace_fn);
+        point.thread = rd.thread;
+        while ((n = rd.decode(&rd, recs, READ_BATCH)) > 0) {
+            rec += n;
+            while (hdr.n_entries * (long long)INDEX_STRIDE < rec)
+                addSeekPoint(&points, &cap, &hdr.n_entries, &point);
+            point.offset = (long long)ftello(rd.fp);
+            point.rec = rec;
+            point.pc = rd.pc;
+            point.timestamp = rd.timestamp;
+            point.thread = rd.thread;
+        }
+        fclose(rd.fp);
+    }
+
+    memcpy(hdr.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    hdr.version = INDEX_VERSION;
+    hdr.stride = INDEX_STRIDE;
+    hdr.format = trace_format;
+    hdr.trace_size = st->st_size;
+    hdr.trace_mtime_ns = st->st_mtim.tv_sec * 1000000000LL
+                         + st->st_mtim.tv_nsec;
+
+    // another run may be reading the index, so replace it atomically
+    snprintf(tmp_fn, sizeof(tmp_fn), "%s.%d", idx_fn, (int)getpid());
+    FILE* idx_fp = fopen(tmp_fn, "wb");
+    if (!idx_fp ||
+        fwrite(&hdr, sizeof(hdr), 1, idx_fp) != 1 ||
+        fwrite(points, sizeof(seek_point_t), hdr.n_entries, idx_fp)
+            != (size_t)hdr.n_entries ||
+        fclose(idx_fp) != 0 || rename(tmp_fn, idx_fn) != 0) {
+        // an unwritable index only costs speed
+        fprintf(stderr, "%s: %s\n", idx_fn, strerror(errno));
+        unlink(tmp_fn);
+    }
+    free(points);
+}
+
+/*
+ * seekRecord - Position trace_fp at or before record rec using the
+ *   <trace>.idx sidecar, building it first if it is missing or stale.
+ *   For a binary trace, rd is its reader, whose state is restored too.
+ *   Returns the number of the record the stream now points at; the
+ *   caller reads forward (about INDEX_STRIDE records at most) from there.
+ */
+long long seekRecord(FILE* trace_fp, char* trace_fn, long long rec,
+                     trace_reader_t* rd) {
+    char idx_fn[PATH_MAX];
+    struct stat st;
+    index_header_t hdr;
+    seek_point_t point;
+
+    if (fstat(fileno(trace_fp), &st) != 0)
+        return 0;
+    snprintf(idx_fn, sizeof(idx_fn), "%s.idx", trace_fn);
+
+    for (int tries = 0; tries < 2; tries++) {
+        FILE* idx_fp = fopen(idx_fn, "rb");
+        int fresh = idx_fp &&
+            fread(&hdr, sizeof(hdr), 1, idx_fp) == 1 &&
+            memcmp(hdr.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) == 0 &&
+            hdr.version == INDEX_VERSION &&
+            hdr.format == trace_format &&
+            hdr.trace_size == st.st_size &&
+            hdr.trace_mtime_ns == st.st_mtim.tv_sec * 1000000000LL
+                                  + st.st_mtim.tv_nsec;
+        if (fresh) {
+            // jump straight to the seek point at or before rec
+            long long i = rec / hdr.stride;
+            if (i >= hdr.n_entries)
+                i = hdr.n_entries - 1;
+            if (i > 0 &&
+                fseeko(idx_fp, (off_t)(sizeof(hdr) + i * sizeof(point)),
+                       SEEK_SET) == 0 &&
+                fread(&point, sizeof(point), 1, idx_fp) == 1 &&
+                fseeko(trace_fp, (off_t)point.offset, SEEK_SET) == 0) {
+                fclose(idx_fp);
+                if (rd) {
+                    rd->pc = point.pc;
+                    rd->timestamp = point.timestamp;
+                    rd->thread = point.thread;
+                }
+                return point.rec;
+            }
+            fclose(idx_fp);
+            return 0;
+        }
+        if (idx_fp)
+            fclose(idx_fp);
+        buildIndex(trace_fn, idx_fn, &st);
+    }
+    return 0;
+}
+
+/*
+ * hllAdd - Add x to a HyperLogLog sketch: the top HLL_P hash bits pick a
+ *   register, which keeps the longest run of leading zeros seen after them.
+ */
+static inline void hllAdd(hll_t* h, unsigned long long x) {
+    unsigned long long hash = hash64(x);
+    int idx = hash >> (64 - HLL_P);
+    // the guard bit bounds the run for an all-zero remainder
+    int rho = __builtin_clzll((hash << HLL_P) | (1ULL << (HLL_P - 1))) + 1;
+
+    if (rho > h->reg[idx])
+        h->reg[idx] = rho;
+}
+
+/*
+ * hllCount - Estimate the number of distinct values added to h, using
+ *   linear counting while many registers are still empty.
+ */
+double hllCount(hll_t* h) {
+    double m = HLL_REGS;
+    double sum = 0;
+    int zeros = 0;
+
+    for (int i = 0; i < HLL_REGS; i++) {
+        sum += ldexp(1.0, -h->reg[i]);
+        zeros += h->reg[i] == 0;
+    }
+    double est = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+    if (est <= 2.5 * m && zeros)
+        est = m * log(m / zeros);
+    return est;
+}
+
+/*
+ * hllMerge - Fold sketch src into dst (the union of both sets).
+ */
+void hllMerge(hll_t* dst, hll_t* src) {
+    for (int i = 0; i < HLL_REGS; i++) {
+        if (src->reg[i] > dst->reg[i])
+            dst->reg[i] = src->reg[i];
+    }
+}
+
+/*
+ * printFootprint - Print estimated distinct blocks and pages, and the
+ *   bytes they cover, against what the cache can hold.
+ */
+void printFootprint(char* label, hll_t* blocks, hll_t* pages) {
+    double nblocks = hllCount(blocks);
+    double npages = hllCount(pages);
+
+    printf("footprint: %s blocks:%.0f (%.1f KiB, %.2fx cache) pages:%.0f "
+           "(%.1f KiB)\n", label, nblocks, nblocks * (1 << b) / 1024,
+           nblocks / ((double)(1 << s) * E), npages,
+           npages * (1 << page_bits) / 1024);
+}
+
+/*
+ * log2Bucket - Histogram bucket of v: 0 for 0, then 1 + floor(log2(v)).
+ */
+static inline int log2Bucket(long long v) {
+    int k = v > 0 ? 64 - __builtin_clzll((unsigned long long)v) : 0;
+    return k < LIFE_BUCKETS ? k : LIFE_BUCKETS - 1;
+}
+
+/*
+ * initLifetimes - Allocate the per-line and per-set lifetime state. Lines
+ *   already filled (e.g. by --restore) have unknown fill times and are
+ *   left out of the statistics.
+ */
+void initLifetimes() {
+    life = malloc((size_t)S * E * sizeof(line_life_t));
+    set_life = calloc(S, sizeof(life_stats_t));
+    if (!life || !set_life) {
+        printf("Cannot malloc lifetime state.");
+        exit(1);
+    }
+    for (size_t i = 0; i < (size_t)S * E; i++)
+        life[i].fill = -1;
+}
+
+/*
+ * regionLife - Find (or claim) the statistics slot of the region holding
+ *   block address addr. A full table folds new regions into other_life.
+ */
+region_life_t* regionLife(mem_addr_t addr) {
+    mem_addr_t key = (addr >> region_bits) + 1;
+    unsigned int i = hash64(key) & (REGION_SLOTS - 1);
+
+    for (int probe = 0; probe < REGION_SLOTS; probe++) {
+        if (region_life[i].region == key)
+            return &region_life[i];
+        if (region_life[i].region == 0) {
+            region_life[i].region = key;
+            return &region_life[i];
+        }
+        i = (i + 1) & (REGION_SLOTS - 1);
+    }
+    return &other_life;
+}
+
+/*
+ * endGeneration - Record the generation of line l, ending at time now,
+ *   in the whole-cache and per-region histograms and the per-set and
+ *   per-region statistics.
+ */
+void endGeneration(line_life_t* l, mem_addr_t set, mem_addr_t tag,
+                   long long now) {
+    if (l->fill < 0)
+        return;
+
+    long long live = l->last_use - l->fill;
+    long long dead = now - l->last_use;
+    region_life_t* r = regionLife(((tag << s) | set) << b);
+    region_life_t* h[2] = { &all_life, r };
+    for (int i = 0; i < 2; i++) {
+        h[i]->hist_hits[log2Bucket(l->hits)]++;
+        h[i]->hist_live[log2Bucket(live)]++;
+        h[i]->hist_dead[log2Bucket(dead)]++;
+    }
+
+    life_stats_t* st[2] = { &set_life[set], &r->st };
+    for (int i = 0; i < 2; i++) {
+        st[i]->fills++;
+        st[i]->dead_fills += l->hits == 0;
+        st[i]->dead_time += dead;
+    }
+}
+
+/*
+ * trackLifetime - Update the lifetime of the line just accessed: a hit
+ *   extends its live time, a fill ends the generation of the evicted line
+ *   and starts a new one.
+ */
+void trackLifetime() {
+    long long now = (long long)(hit_cnt + miss_cnt);
+    mem_addr_t set = last_access.set;
+    line_life_t* l = &life[set * E + last_access.way];
+
+    if (last_access.result & ACCESS_HIT) {
+        l->hits++;
+        l->last_use = now;
+        return;
+    }
+    if (last_access.result & ACCESS_EVICT)
+        endGeneration(l, set, last_access.victim_tag, now);
+    l->fill = now;
+    l->last_use = now;
+    l->hits = 0;
+}
+
+/*
+ * invalidateLine - Drop a line from the cache. Like an eviction, this ends
+ *   the line's --lifetimes generation.
+ */
+void invalidateLine(mem_addr_t set, int way) {
+    if (lifetimes) {
+        line_life_t* l = &life[set * E + way];
+        endGeneration(l, set, cache[set][way].tag,
+                      (long long)(hit_cnt + miss_cnt));
+        l->fill = -1;
+    }
+    cache[set][way].valid = '0';
+}
+
+/*
+ * accessBypass - A non-temporal access to addr. A hit is served from the
+ *   cache without touching recency, and a store also invalidates the
+ *   line, as a streaming store evicts it; a miss goes to memory without
+ *   allocating a line.
+ */
+void accessBypass(mem_addr_t addr, int store) {
+    S = 2 << (s-1);
+    B = 2 << (b-1);
+    mem_addr_t addrTag = addr / (B * S);
+    mem_addr_t setNum = (addr / B) % S;
+    cache_line_t* lines = cache[setNum];
+
+    last_access.set = setNum;
+    for (int i = 0; i < E; i++) {
+        if (lineValid(&lines[i]) && lines[i].tag == addrTag) {
+            hit_cnt++;
+            last_access.way = i;
+            last_access.result = ACCESS_HIT | ACCESS_BYPASS;
+            if (store) {
+                invalidateLine(setNum, i);
+                invalidate_cnt++;
+            }
+            return;
+        }
+    }
+    miss_cnt++;
+    bypass_cnt++;
+    last_access.way = 0;
+    last_access.result = ACCESS_MISS | ACCESS_BYPASS;
+}
+
+/*
+ * flushData - Apply a cache control record: F (clflush) drops the line
+ *   holding addr, W (clwb) writes it back and keeps it, which changes
+ *   nothing without dirty state, and G invalidates the whole cache by
+ *   starting a new epoch, in O(1).
+ */
+void flushData(char op, mem_addr_t addr) {
+    if (op == 'G') {
+        global_inval_cnt++;
+        // the generations of the resident lines end here
+        for (size_t i = 0; lifetimes && i < (size_t)S * E; i++) {
+            if (lineValid(&(*cache)[i]))
+                invalidateLine(i / E, i % E);
+        }
+        // after a wrap, lines of the reused epoch would look valid again
+        if (++cache_epoch == 0) {
+            for (size_t i = 0; i < (size_t)S * E; i++)
+                (*cache)[i].valid = '0';
+        }
+        return;
+    }
+
+    flush_cnt++;
+    if (op != 'F')
+        return;
+    S = 2 << (s-1);
+    B = 2 << (b-1);
+    mem_addr_t addrTag = addr / (B * S);
+    mem_addr_t setNum = (addr / B) % S;
+    cache_line_t* lines = cache[setNum];
+    for (int i = 0; i < E; i++) {
+        if (lineValid(&lines[i]) && lines[i].tag == addrTag) {
+            invalidateLine(setNum, i);
+            invalidate_cnt++;
+            return;
+        }
+    }
+}
+
+/*
+ * printHistogram - Print the non-empty buckets of a log2 histogram,
+ *   indented by indent.
+ */
+void printHistogram(char* indent, char* name, long long* hist) {
+    printf("lifetime: %s%-5s", indent, name);
+    for (int k = 0; k < LIFE_BUCKETS; k++) {
+        if (hist[k] == 0)
+            continue;
+        if (k <= 1)
+            printf(" %d:%lld", k, hist[k]);
+        else
+            printf(" %lld-%lld:%lld", 1LL << (k - 1), (1LL << k) - 1, hist[k]);
+    }
+    printf("\n");
+}
+
+/*
+ * printLifeStats - Print one line of per-set or per-region statistics.
+ */
+void printLifeStats(char* label, life_stats_t* st) {
+    printf("lifetime: %s fills:%lld never-reused:%lld (%.1f%%) "
+           "mean-dead:%.1f\n", label, st->fills, st->dead_fills,
+           st->fills ? 100.0 * st->dead_fills / st->fills : 0,
+           st->fills ? (double)st->dead_time / st->fills : 0);
+}
+
+/*
+ * compareDeadFills - qsort comparator: most never-reused fills first.
+ */
+int compareDeadFills(const void* a, const void* b) {
+    const life_stats_t* x = a;
+    const life_stats_t* y = b;
+    return (y->dead_fills > x->dead_fills) - (y->dead_fills < x->dead_fills);
+}
+
+/*
+ * compareRegionDeadFills - qsort comparator for regions: most never-reused
+ *   fills first.
+ */
+int compareRegionDeadFills(const void* a, const void* b) {
+    return compareDeadFills(&((const region_life_t*)a)->st,
+                            &((const region_life_t*)b)->st);
+}
+
+/*
+ * printRegionLife - Print the statistics and histograms of a region.
+ */
+void printRegionLife(char* label, region_life_t* r) {
+    printLifeStats(label, &r->st);
+    printHistogram("  ", "hits", r->hist_hits);
+    printHistogram("  ", "live", r->hist_live);
+    printHistogram("  ", "dead", r->hist_dead);
+}
+
+/*
+ * compareSetDeadFills - qsort comparator for set numbers: the set with the
+ *   most never-reused fills first.
+ */
+int compareSetDeadFills(const void* a, const void* b) {
+    return compareDeadFills(&set_life[*(const int*)a],
+                            &set_life[*(const int*)b]);
+}
+
+/*
+ * reportLifetimes - Print histograms of hits per generation, live time
+ *   and dead time, then the sets and regions with the most lines that
+ *   were filled and never reused: the candidates for bypass or
+ *   non-temporal stores. Each of those regions gets its own histograms.
+ *   Lines still resident at the end are counted but have no dead time
+ *   yet.
+ */
+void reportLifetimes() {
+    long long gens = 0, dead = 0, resident = 0, resident_dead = 0;
+    char label[64];
+
+    for (int k = 0; k < LIFE_BUCKETS; k++)
+        gens += all_life.hist_hits[k];
+    dead = all_life.hist_hits[0];
+    for (size_t i = 0; i < (size_t)S * E; i++) {
+        if (life[i].fill >= 0) {
+            resident++;
+            resident_dead += life[i].hits == 0;
+        }
+    }
+    printf("lifetime: generations:%lld never-reused:%lld (%.1f%%) "
+           "resident:%lld (never-reused %lld)\n", gens, dead,
+           gens ? 100.0 * dead / gens : 0, resident, resident_dead);
+    printHistogram("", "hits", all_life.hist_hits);
+    printHistogram("", "live", all_life.hist_live);
+    printHistogram("", "dead", all_life.hist_dead);
+
+    // worst sets
+    int* order = malloc(S * sizeof(int));
+    if (!order) {
+        printf("Cannot malloc lifetime report.");
+        exit(1);
+    }
+    for (int i = 0; i < S; i++)
+        order[i] = i;
+    qsort(order, S, sizeof(int), compareSetDeadFills);
+    for (int i = 0; i < S && i < 10 && set_life[order[i]].fills; i++) {
+        snprintf(label, sizeof(label), "set %d", order[i]);
+        printLifeStats(label, &set_life[order[i]]);
+    }
+    free(order);
+
+    // worst regions
+    qsort(region_life, REGION_SLOTS, sizeof(region_life_t),
+          compareRegionDeadFills);
+    for (int i = 0; i < 10 && region_life[i].region; i++) {
+        snprintf(label, sizeof(label), "region %#llx",
+                 (region_life[i].region - 1) << region_bits);
+        printRegionLife(label, &region_life[i]);
+    }
+    if (other_life.st.fills)
+        printRegionLife("other regions", &other_life);
+
+    free(set_life);
+    free(life);
+}
+
+/*
+ * findStream - Find (or claim) the stream of the region holding addr. A
+ *   full table folds new regions into other_stream.
+ */
+stream_t* findStream(mem_addr_t addr) {
+    mem_addr_t key = (addr >> region_bits) + 1;
+    unsigned int i = hash64(key) & (STREAM_SLOTS - 1);
+
+    for (int probe = 0; probe < STREAM_SLOTS; probe++) {
+        if (streams[i].region == key)
+            return &streams[i];
+        if (streams[i].region == 0) {
+            streams[i].region = key;
+            streams[i].cls = CLASS_IRREGULAR;
+            return &streams[i];
+        }
+        i = (i + 1) & (STREAM_SLOTS - 1);
+    }
+    return &other_stream;
+}
+
+/*
+ * classifyAccess - Classify the access just made from the block stride
+ *   of its stream and charge it, and a miss, to that class. Repeated
+ *   accesses to the same block keep the stream's class.
+ */
+void classifyAccess(mem_addr_t addr) {
+    stream_t* st = findStream(addr);
+    mem_addr_t block = addr >> b;
+    long long delta = (long long)(block - st->last_block);
+
+    if (st->accesses[0] + st->accesses[1] + st->accesses[2] == 0) {
+        st->cls = CLASS_IRREGULAR;
+    } else if (delta != 0) {
+        if (delta == st->stride) {
+            if (st->conf < 3)
+                st->conf++;
+        } else {
+            st->stride = delta;
+            st->conf = 0;
+        }
+        st->cls = st->conf == 0 ? CLASS_IRREGULAR :
+                  (delta == 1 || delta == -1) ? CLASS_SEQUENTIAL :
+                  CLASS_STRIDED;
+    }
+    st->last_block = block;
+
+    int miss = (last_access.result & ACCESS_MISS) != 0;
+    st->accesses[st->cls]++;
+    st->misses[st->cls] += miss;
+    class_accesses[st->cls]++;
+    class_misses[st->cls] += miss;
+}
+
+/*
+ * streamMisses - Total misses of a stream.
+ */
+long long streamMisses(const stream_t* st) {
+    return st->misses[0] + st->misses[1] + st->misses[2];
+}
+
+/*
+ * compareStreamMisses - qsort comparator: the stream with most misses
+ *   first.
+ */
+int compareStreamMisses(const void* a, const void* b) {
+    long long x = streamMisses(a), y = streamMisses(b);
+    return (y > x) - (y < x);
+}
+
+/*
+ * reportClasses - Print accesses and misses per access class, then the
+ *   streams causing the most misses with their dominant class. Sequential
+ *   and strided streams that miss are prefetching candidates; irregular
+ *   ones point at layout or tiling.
+ */
+void reportClasses() {
+    long long total = 0;
+
+    for (int k = 0; k < CLASSES; k++)
+        total += class_misses[k];
+    for (int k = 0; k < CLASSES; k++)
+        printf("classify: %-10s accesses:%lld misses:%lld (%.1f%% of misses)"
+               "\n", class_names[k], class_accesses[k], class_misses[k],
+               total ? 100.0 * class_misses[k] / total : 0);
+
+    qsort(streams, STREAM_SLOTS, sizeof(stream_t), compareStreamMisses);
+    for (int i = 0; i < 10 && streams[i].region; i++) {
+        stream_t* st = &streams[i];
+        int dom = 0;
+        for (int k = 1; k < CLASSES; k++) {
+            if (st->accesses[k] > st->accesses[dom])
+                dom = k;
+        }
+        long long n = st->accesses[0] + st->accesses[1] + st->accesses[2];
+        printf("classify: stream %#llx %s", (st->region - 1) << region_bits,
+               class_names[dom]);
+        if (dom == CLASS_STRIDED)
+            printf(" (stride %lld blocks)", st->stride);
+        printf(" accesses:%lld misses:%lld miss-rate:%.1f%%\n", n,
+               streamMisses(st), n ? 100.0 * streamMisses(st) / n : 0);
+    }
+    if (other_stream.accesses[0] + other_stream.accesses[1]
+        + other_stream.accesses[2])
+        printf("classify: other streams misses:%lld\n",
+               streamMisses(&other_stream));
+}
+
+/*
+ * stackResize - Renumber the marked slots of st into a table of new_cap
+ *   slots, keeping their order, and rebuild the Fenwick tree.
+ */
+void stackResize(lru_stack_t* st, long long new_cap) {
+    long long* remap = malloc((st->cap ? st->cap : 1) * sizeof(long long));
+    int* bit = calloc(new_cap + 1, sizeof(int));
+    char* mark = calloc(new_cap, 1);
+    mem_addr_t* slot_block = malloc(new_cap * sizeof(mem_addr_t));
+    long long j = 0;
+
+    if (!remap || !bit || !mark || !slot_block) {
+        printf("Cannot malloc reuse-distance stack.");
+        exit(1);
+    }
+    for (long long i = 0; i < st->now; i++) {
+        if (st->mark[i]) {
+            remap[i] = j;
+            mark[j] = 1;
+            slot_block[j++] = st->slot_block[i];
+        }
+    }
+    for (long long i = 0; i < st->map_cap; i++) {
+        if (st->keys[i])
+            st->slots[i] = remap[st->slots[i]];
+    }
+    // linear-time Fenwick build
+    for (long long i = 1; i <= new_cap; i++) {
+        bit[i] += mark[i - 1];
+        long long up = i + (i & -i);
+        if (up <= new_cap)
+            bit[up] += bit[i];
+    }
+
+    free(remap);
+    free(st->bit);
+    free(st->mark);
+    free(st->slot_block);
+    st->bit = bit;
+    st->mark = mark;
+    st->slot_block = slot_block;
+    st->cap = new_cap;
+    st->now = j;
+}
+
+/*
+ * stackSlot - Find block in the hash map of st, inserting it with slot -1
+ *   if absent. Returns a pointer to its slot.
+ */
+long long* stackSlot(lru_stack_t* st, mem_addr_t block) {
+    if (2 * (st->distinct + 1) > st->map_cap) {
+        // grow the map
+        long long old_cap = st->map_cap;
+        mem_addr_t* old_keys = st->keys;
+        long long* old_slots = st->slots;
+        st->map_cap = old_cap ? 2 * old_cap : 1 << 16;
+        st->keys = calloc(st->map_cap, sizeof(mem_addr_t));
+        st->slots = malloc(st->map_cap * sizeof(long long));
+        if (!st->keys || !st->slots) {
+            printf("Cannot malloc reuse-distance stack.");
+            exit(1);
+        }
+        for (long long i = 0; i < old_cap; i++) {
+            if (old_keys[i]) {
+                long long k = hash64(old_keys[i]) & (st->map_cap - 1);
+                while (st->keys[k])
+                    k = (k + 1) & (st->map_cap - 1);
+                st->keys[k] = old_keys[i];
+                st->slots[k] = old_slots[i];
+            }
+        }
+        free(old_keys);
+        free(old_slots);
+    }
+
+    long long k = hash64(block + 1) & (st->map_cap - 1);
+    while (st->keys[k] && st->keys[k] != block + 1)
+        k = (k + 1) & (st->map_cap - 1);
+    if (!st->keys[k]) {
+        st->keys[k] = block + 1;
+        st->slots[k] = -1;
+    }
+    return &st->slots[k];
+}
+
+/*
+ * bitAdd/bitSum - Fenwick tree update of slot i, and the number of marks
+ *   in slots [0, i).
+ */
+static inline void bitAdd(lru_stack_t* st, long long i, int v) {
+    for (i++; i <= st->cap; i += i & -i)
+        st->bit[i] += v;
+}
+
+static inline long long bitSum(lru_stack_t* st, long long i) {
+    long long sum = 0;
+    for (; i > 0; i -= i & -i)
+        sum += st->bit[i];
+    return sum;
+}
+
+/*
+ * stackAccess - Access block: return its reuse distance, or -1 on the
+ *   first access, and move it to the top of the stack.
+ */
+long long stackAccess(lru_stack_t* st, mem_addr_t block) {
+    long long dist = -1;
+
+    if (st->now == st->cap) {
+        long long cap = 1 << 16;
+        while (cap < 4 * (st->distinct + 1))
+            cap *= 2;
+        stackResize(st, cap);
+    }
+
+    long long* slot = stackSlot(st, block);
+    if (*slot >= 0) {
+        dist = bitSum(st, st->now) - bitSum(st, *slot + 1);
+        st->mark[*slot] = 0;
+        bitAdd(st, *slot, -1);
+    } else {
+        st->distinct++;
+    }
+    st->mark[st->now] = 1;
+    st->slot_block[st->now] = block;
+    bitAdd(st, st->now, 1);
+    *slot = st->now++;
+    return dist;
+}
+
+/*
+ * stackBlockAt - Return the block at reuse distance dist (0 is the most
+ *   recent), which must be less than st->distinct.
+ */
+mem_addr_t stackBlockAt(lru_stack_t* st, long long dist) {
+    long long rank = st->distinct - dist;   // 1-based, oldest first
+    long long pos = 0;
+
+    for (long long step = st->cap; step; step >>= 1) {
+        if (pos + step <= st->cap && st->bit[pos + step] < rank) {
+            pos += step;
+            rank -= st->bit[pos];
+        }
+    }
+    return st->slot_block[pos];
+}
+
+/*
+ * stackFree - Release the tables of st.
+ */
+void stackFree(lru_stack_t* st) {
+    free(st->bit);
+    free(st->mark);
+    free(st->slot_block);
+    free(st->keys);
+    free(st->slots);
+    memset(st, 0, sizeof(*st));
+}
+
+/*
+ * profileRecord - Add one record to the reuse-distance profile: its op,
+ *   size and reuse distance, and for a first access the delta from the
+ *   previous first access.
+ */
+void profileRecord(char op, mem_addr_t address, unsigned int len) {
+    mem_addr_t block = address >> b;
+    long long dist = stackAccess(&reuse_stack, block);
+
+    op_counts[op == 'L' || op == 'X' ? 0 : op == 'S' || op == 'N' ? 1 : 2]++;
+    len_counts[len < 16 ? len : 16]++;
+    if (dist >= 0) {
+        reuse_hist[log2Bucket(dist)]++;
+        return;
+    }
+
+    reuse_cold++;
+    long long delta = (long long)(block - last_cold);
+    if (delta == 1 || delta == -1) {
+        cold_class[CLASS_SEQUENTIAL]++;
+    } else if (delta == last_cold_delta) {
+        cold_class[CLASS_STRIDED]++;
+        int i;
+        for (i = 0; i < n_strides && stride_val[i] != delta; i++)
+            ;
+        if (i == n_strides && n_strides < MAX_STRIDES)
+            stride_val[n_strides++] = delta;
+        if (i < n_strides)
+            stride_cnt[i]++;
+    } else {
+        cold_class[CLASS_IRREGULAR]++;
+    }
+    last_cold_delta = delta;
+    last_cold = block;
+}
+
+/*
+ * writeReuseProfile - Write the measured profile as "<key> <values>"
+ *   lines, the format --gen-profile reads.
+ */
+void writeReuseProfile() {
+    FILE* prof_fp = fopen(reuse_profile, "w");
+
+    if (!prof_fp) {
+        fprintf(stderr, "%s: %s\n", reuse_profile, strerror(errno));
+        exit(1);
+    }
+    fprintf(prof_fp, "%s %d\n", PROFILE_MAGIC, PROFILE_VERSION);
+    fprintf(prof_fp, "block-bits %d\n", b);
+    fprintf(prof_fp, "ops %lld %lld %lld\n", op_counts[0], op_counts[1],
+            op_counts[2]);
+    for (int i = 0; i <= 16; i++) {
+        if (len_counts[i])
+            fprintf(prof_fp, "len %d %lld\n", i, len_counts[i]);
+    }
+    fprintf(prof_fp, "cold %lld\n", reuse_cold);
+    // bucket k holds distances 2^(k-1) .. 2^k-1 (bucket 0: distance 0)
+    for (int k = 0; k < LIFE_BUCKETS; k++) {
+        if (reuse_hist[k])
+            fprintf(prof_fp, "reuse %d %lld\n", k, reuse_hist[k]);
+    }
+    fprintf(prof_fp, "cold-class %lld %lld %lld\n",
+            cold_class[CLASS_SEQUENTIAL], cold_class[CLASS_STRIDED],
+            cold_class[CLASS_IRREGULAR]);
+    for (int i = 0; i < n_strides; i++)
+        fprintf(prof_fp, "stride %lld %lld\n", stride_val[i], stride_cnt[i]);
+    if (fclose(prof_fp) != 0) {
+        fprintf(stderr, "%s: %s\n", reuse_profile, strerror(errno));
+        exit(1);
+    }
+    stackFree(&reuse_stack);
+}
+
+/*
+ * findTenant - The tenant an access to addr by cur_thread of cur_source
+ *   belongs to.
+ */
+tenant_t* findTenant(mem_addr_t addr) {
+    for (int i = 0; i < n_tenants; i++) {
+        tenant_t* t = &tenants[i];
+        if ((t->thread < 0 || t->thread == cur_thread) &&
+            (t->source < 0 || t->source == cur_source) &&
+            (t->hi <= t->lo || (addr >= t->lo && addr < t->hi)))
+            return t;
+    }
+    return &other_tenant;
+}
+
+/*
+ * printTenant - Print the way mask and counters of one tenant.
+ */
+void printTenant(char* label, tenant_t* t) {
+    long long n = t->hits + t->misses;
+    unsigned long long all_ways = wayMask(E);
+
+    printf("cat: %-28s mask %#llx accesses:%lld hits:%lld misses:%lld "
+           "evictions:%lld hit-rate:%.2f%%\n", label, t->mask & all_ways, n,
+           t->hits,
+           t->misses, t->evicts, n ? 100.0 * t->hits / n : 0);
+}
+
+/*
+ * tenantLabel - Describe the selector of tenant i in label.
+ */
+void tenantLabel(char* label, size_t size, int i) {
+    tenant_t* t = &tenants[i];
+
+    if (t->thread >= 0)
+        snprintf(label, size, "tenant %d (thread %d)", i, t->thread);
+    else if (t->source >= 0)
+        snprintf(label, size, "tenant %d (source %d)", i, t->source);
+    else
+        snprintf(label, size, "tenant %d (%llx-%llx)", i, t->lo, t->hi);
+}
+
+/*
+ * reportTenants - Print the counters of each --cat tenant.
+ */
+void reportTenants() {
+    char label[64];
+
+    for (int i = 0; i < n_tenants; i++) {
+        tenantLabel(label, sizeof(label), i);
+        printTenant(label, &tenants[i]);
+    }
+    if (other_tenant.hits + other_tenant.misses)
+        printTenant("other", &other_tenant);
+}
+
+/*
+ * reportCorun - Print the counters of each --corun source, and how many
+ *   of its lines each other source evicted.
+ */
+void reportCorun() {
+    for (int i = 0; i < n_sources; i++) {
+        corun_src_t* src = &sources[i];
+        long long accesses = src->hits + src->misses;
+        long long lost = 0;
+
+        for (int j = 0; j < n_sources; j++)
+            if (j != i)
+                lost += cross_evict[i * n_sources + j];
+        printf("source %d (%s): records:%lld hits:%lld misses:%lld "
+               "evictions:%lld hit rate:%.2f%% evicted by others:%lld\n",
+               i, src->trace_fn, src->issued, src->hits, src->misses,
+               src->evicts, accesses ? 100.0 * src->hits / accesses : 0,
+               lost);
+    }
+    for (int i = 0; i < n_sources; i++)
+        for (int j = 0; j < n_sources; j++)
+            if (j != i && cross_evict[i * n_sources + j])
+                printf("corun: source %d evicted %lld lines of source %d\n",
+                       j, cross_evict[i * n_sources + j], i);
+}
+
+/*
+ * endInterval - Close an --interval: report and reset the per-interval
+ *   state of each enabled analysis.
+ */
+void endInterval() {
+    char label[64];
+
+    interval_cnt++;
+    snprintf(label, sizeof(label), "interval %lld (records %lld-%lld)",
+             interval_cnt, rec_cnt - interval_len, rec_cnt - 1);
+    if (footprint) {
+        printFootprint(label, &fp_blocks, &fp_pages);
+        hllMerge(&fp_all_blocks, &fp_blocks);
+        hllMerge(&fp_all_pages, &fp_pages);
+        memset(&fp_blocks, 0, sizeof(fp_blocks));
+        memset(&fp_pages, 0, sizeof(fp_pages));
+    }
+}
+
+/*
+ * endAnalyses - Fold the last partial interval into the whole-run results
+ *   and report them.
+ */
+void endAnalyses() {
+    if (sources)
+        reportCorun();
+    if (partitioned)
+        reportTenants();
+    if (bypass_cnt || invalidate_cnt || flush_cnt || global_inval_cnt)
+        printf("cache control: bypassed:%lld invalidated:%lld flushes:%lld "
+               "global-invalidations:%lld\n", bypass_cnt, invalidate_cnt,
+               flush_cnt, global_inval_cnt);
+    if (reuse_profile)
+        writeReuseProfile();
+    if (classify)
+        reportClasses();
+    if (lifetimes)
+        reportLifetimes();
+    if (footprint) {
+        hllMerge(&fp_all_blocks, &fp_blocks);
+        hllMerge(&fp_all_pages, &fp_pages);
+        printFootprint("total", &fp_all_blocks, &fp_all_pages);
+    }
+}
+
+/*
+ * logAccess - Report the outcome of the access just made: append "hit",
+ *   "miss" or "miss eviction" to the -v line and write an event to
+ *   --event-log. Events go through a large stdio buffer, so logging costs
+ *   a memory copy per access rather than a write.
+ */
+void logAccess(char op, mem_addr_t address) {
+    int result = last_access.result;
+
+    if (profiling)
+        profStage(PROF_ACCESS);
+    if (verbosity)
+        printf(result & ACCESS_HIT ? "hit " :
+               result & ACCESS_EVICT ? "miss eviction " : "miss ");
+    if (event_binary) {
+        event_rec_t ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.addr = address;
+        ev.victim_tag = result & ACCESS_EVICT ? last_access.victim_tag : 0;
+        ev.set = last_access.set;
+        ev.op = op;
+        ev.result = result;
+        fwrite(&ev, sizeof(ev), 1, event_fp);
+    } else if (event_fp) {
+        // "<op> <addr> <set> <H|M|E> [<victim tag>]"
+        if (result & ACCESS_EVICT)
+            fprintf(event_fp, "%c %llx %llu E %llx\n", op, address,
+                    last_access.set, last_access.victim_tag);
+        else
+            fprintf(event_fp, "%c %llx %llu %c\n", op, address,
+                    last_access.set, result & ACCESS_HIT ? 'H' : 'M');
+    }
+    if (profiling)
+        profStage(PROF_OUTPUT);
+}
+
+/*
+ * observeAccess - Run the per-access hooks after accessData(): the
+ *   analyses that need each outcome, then the -v and --event-log output.
+ */
+void observeAccess(char op, mem_addr_t address) {
+    // a bypass fills no line, so it starts or extends no lifetime
+    if (lifetimes && !(last_access.result & ACCESS_BYPASS))
+        trackLifetime();
+    if (classify)
+        classifyAccess(address);
+    if (verbosity || event_fp)
+        logAccess(op, address);
+}
+
+/*
+ * replayRecord - Simulate one trace record. L and S access the cache
+ *   once; M is a load followed by a store to the same address. X and N
+ *   bypass the cache, and F, W and G are handed to flushData().
+ */
+void replayRecord(char op, mem_addr_t address, unsigned int len) {
+    // flushes and invalidations change the cache but are not accesses
+    if (op == 'F' || op == 'W' || op == 'G') {
+        flushData(op, address);
+        if (verbosity && op == 'G')
+            printf("G\n");
+        else if (verbosity)
+            printf("%c %llx,%u\n", op, address, len);
+        return;
+    }
+    if (footprint) {
+        hllAdd(&fp_blocks, address >> b);
+        hllAdd(&fp_pages, address >> page_bits);
+    }
+    if (reuse_profile)
+        profileRecord(op, address, len);
+    if (verbosity) {
+        printf("%c %llx,%u ", op, address, len);
+        if (profiling)
+            profStage(PROF_OUTPUT);
+    }
+
+    // charge the accesses of this record to its --cat tenant
+    tenant_t* tenant = NULL;
+    unsigned long long hits0 = hit_cnt, misses0 = miss_cnt,
+                           evicts0 = evict_cnt;
+    if (partitioned) {
+        tenant = findTenant(address);
+        access_mask = tenant->mask;
+    }
+
+    // call accessData function here depending on type of access
+    if (op == 'S' || op == 'L') {
+         accessData(address);
+         if (observing)
+             observeAccess(op, address);
+    }
+
+    if (op == 'M') {
+        accessData(address);
+        if (observing)
+            observeAccess(op, address);
+        accessData(address);
+        if (observing)
+            observeAccess(op, address);
+    }
+
+    if (op == 'X' || op == 'N') {
+        accessBypass(address, op == 'N');
+        if (observing)
+            observeAccess(op, address);
+    }
+    if (tenant) {
+        tenant->hits += hit_cnt - hits0;
+        tenant->misses += miss_cnt - misses0;
+        tenant->evicts += evict_cnt - evicts0;
+    }
+    if (profiling) {
+        profStage(PROF_ACCESS);
+        prof_records++;
+    }
+    if (verbosity) {
+        printf("\n");
+        if (profiling)
+            profStage(PROF_OUTPUT);
+    }
+}
+
+/*
+ * statsAdd - Append a numeric (printf-formatted) field to the statistics.
+ */
+void statsAdd(const char* section, const char* key, const char* fmt, ...) {
+    va_list ap;
+
+    assert(n_stats < MAX_STATS);
+    stat_field_t* f = &stats[n_stats++];
+    f->section = section;
+    f->key = key;
+    f->is_string = 0;
+    va_start(ap, fmt);
+    vsnprintf(f->value, sizeof(f->value), fmt, ap);
+    va_end(ap);
+}
+
+/*
+ * statsAddString - Append a string field to the statistics.
+ */
+void statsAddString(const char* section, const char* key, const char* str) {
+    statsAdd(section, key, "%s", str ? str : "");
+    stats[n_stats - 1].is_string = str ? 1 : 2;
+}
+
+/*
+ * writeQuoted - Write str as a JSON string, or as a CSV field quoted by
+ *   doubling embedded quotes.
+ */
+void writeQuoted(FILE* fp, const char* str, int csv) {
+    fputc('"', fp);
+    for (const char* p = str; *p; p++) {
+        if (*p == '"')
+            fputs(csv ? "\"\"" : "\\\"", fp);
+        else if (*p == '\\' && !csv)
+            fputs("\\\\", fp);
+        else if ((unsigned char)*p < 0x20 && !csv)
+            fprintf(fp, "\\u%04x", *p);
+        else
+            fputc(*p, fp);
+    }
+    fputc('"', fp);
+}
+
+/*
+ * writeStats - Collect the configuration, counters, derived rates, timing
+ *   and host information of this run and write them to out_fn (normally
+ *   --stats-out) in JSON or CSV. A snapshot of a running simulation adds
+ *   an interval section with the counters since the previous snapshot.
+ *   The file is written under a temporary name and renamed, so a reader
+ *   never sees it half written. Returns 0 on success.
+ */
+int writeStats(char* out_fn, double wall, int memoized, int snapshot) {
+    char tmp_fn[PATH_MAX];
+    struct utsname host;
+    long long accesses = (long long)(hit_cnt + miss_cnt);
+
+    // schema: STATS_SCHEMA. Consumers may rely on the field order, so
+    // adding or moving a field bumps the version. Version 2 added, after
+    // the version 1 fields of their sections:
+    //   config: ops, addr_ranges, format, sources
+    //   counters: filtered, bypassed, invalidated, flushes,
+    //             global_invalidations
+    n_stats = 0;
+    statsAddString("config", "trace", trace_file);
+    statsAdd("config", "s", "%d", s);
+    statsAdd("config", "E", "%d", E);
+    statsAdd("config", "b", "%d", b);
+    statsAdd("config", "S", "%d", 1 << s);
+    statsAdd("config", "B", "%d", 1 << b);
+    statsAddString("config", "policy", policy_name);
+    statsAdd("config", "skip", "%lld", skip_to < 0 ? 0 : skip_to);
+    statsAdd("config", "limit", "%lld", rec_limit);
+    statsAddString("config", "restore", restore_file);
+    statsAddString("config", "ops", filter_ops);
+    statsAdd("config", "addr_ranges", "%d", n_ranges);
+    statsAddString("config", "format", format_names[trace_format]);
+    statsAdd("config", "sources", "%d", n_sources);
+    statsAdd("counters", "records", "%lld", rec_cnt);
+    statsAdd("counters", "accesses", "%lld", accesses);
+    statsAdd("counters", "hits", "%llu", hit_cnt);
+    statsAdd("counters", "misses", "%llu", miss_cnt);
+    statsAdd("counters", "evictions", "%llu", evict_cnt);
+    statsAdd("counters", "filtered", "%lld", filtered_cnt);
+    statsAdd("counters", "bypassed", "%lld", bypass_cnt);
+    statsAdd("counters", "invalidated", "%lld", invalidate_cnt);
+    statsAdd("counters", "flushes", "%lld", flush_cnt);
+    statsAdd("counters", "global_invalidations", "%lld", global_inval_cnt);
+    statsAdd("rates", "hit_rate", "%.6f",
+             accesses ? (double)hit_cnt / accesses : 0);
+    statsAdd("rates", "miss_rate", "%.6f",
+             accesses ? (double)miss_cnt / accesses : 0);
+    statsAdd("rates", "eviction_rate", "%.6f",
+             accesses ? (double)evict_cnt / accesses : 0);
+    statsAdd("timing", "wall_seconds", "%.6f", wall);
+    statsAdd("timing", "accesses_per_sec", "%.0f",
+             wall > 0 ? (accesses - restored_accesses) / wall : 0);
+    statsAdd("timing", "memoized", "%s", memoized ? "true" : "false");
+    uname(&host);
+    statsAddString("host", "name", host.nodename);
+    statsAddString("host", "system", host.sysname);
+    statsAddString("host", "release", host.release);
+    statsAddString("host", "machine", host.machine);
+    statsAdd("host", "cpus", "%ld", sysconf(_SC_NPROCESSORS_ONLN));
+    statsAdd("host", "pid", "%d", (int)getpid());
+    if (footprint) {
+        hll_t all_blocks = fp_all_blocks, all_pages = fp_all_pages;
+        hllMerge(&all_blocks, &fp_blocks);
+        hllMerge(&all_pages, &fp_pages);
+        statsAdd("footprint", "distinct_blocks", "%.0f",
+                 hllCount(&all_blocks));
+        statsAdd("footprint", "distinct_pages", "%.0f", hllCount(&all_pages));
+        statsAdd("footprint", "page_bytes", "%d", 1 << page_bits);
+    }
+    // the field names must outlive this call
+    static char cat_keys[MAX_TENANTS + 1][4][24];
+    const char* cat_fields[4] = { "mask", "hits", "misses", "evictions" };
+    unsigned long long all_ways = wayMask(E);
+    for (int i = 0; i <= n_tenants && partitioned; i++) {
+        tenant_t* t = i < n_tenants ? &tenants[i] : &other_tenant;
+        long long values[4] = { (long long)(t->mask & all_ways), t->hits,
+                                t->misses, t->evicts };
+        for (int k = 0; k < 4; k++) {
+            if (i < n_tenants)
+                snprintf(cat_keys[i][k], sizeof(cat_keys[i][k]),
+                         "tenant%d_%s", i, cat_fields[k]);
+            else
+                snprintf(cat_keys[i][k], sizeof(cat_keys[i][k]), "other_%s",
+                         cat_fields[k]);
+            statsAdd("cat", cat_keys[i][k], "%lld", values[k]);
+        }
+    }
+    static char corun_keys[MAX_SOURCES][5][32];
+    const char* corun_fields[5] = { "records", "hits", "misses", "evictions",
+                                    "evicted_by_others" };
+    for (int i = 0; i < n_sources && sources; i++) {
+        corun_src_t* src = &sources[i];
+        long long values[5] = { src->issued, src->hits, src->misses,
+                                src->evicts, 0 };
+        for (int j = 0; j < n_sources; j++)
+            if (j != i)
+                values[4] += cross_evict[i * n_sources + j];
+        for (int k = 0; k < 5; k++) {
+            snprintf(corun_keys[i][k], sizeof(corun_keys[i][k]),
+                     "source%d_%s", i, corun_fields[k]);
+            statsAdd("corun", corun_keys[i][k], "%lld", values[k]);
+        }
+    }
+    if (snapshot) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        statsAdd("interval", "seconds", "%.6f",
+                 (now.tv_sec - dump_ts.tv_sec)
+                 + (now.tv_nsec - dump_ts.tv_nsec) / 1e9);
+        statsAdd("interval", "records", "%lld", rec_cnt - dump_rec);
+        statsAdd("interval", "hits", "%llu", hit_cnt - dump_hits);
+        statsAdd("interval", "misses", "%llu", miss_cnt - dump_misses);
+        statsAdd("interval", "evictions", "%llu", evict_cnt - dump_evicts);
+        unsigned long long n = hit_cnt - dump_hits + miss_cnt - dump_misses;
+        statsAdd("interval", "miss_rate", "%.6f",
+                 n ? (double)(miss_cnt - dump_misses) / n : 0);
+        dump_ts = now;
+        dump_rec = rec_cnt;
+        dump_hits = hit_cnt;
+        dump_misses = miss_cnt;
+        dump_evicts = evict_cnt;
+    }
+
+    snprintf(tmp_fn, sizeof(tmp_fn), "%s.%d", out_fn, (int)getpid());
+    FILE* stats_fp = fopen(tmp_fn, "w");
+    if (!stats_fp) {
+        fprintf(stderr, "%s: %s\n", tmp_fn, strerror(errno));
+        return -1;
+    }
+    if (stats_csv) {
+        fprintf(stats_fp, "schema");
+        for (int i = 0; i < n_stats; i++)
+            fprintf(stats_fp, ",%s_%s", stats[i].section, stats[i].key);
+        fprintf(stats_fp, "\n" STATS_SCHEMA);
+        for (int i = 0; i < n_stats; i++) {
+            fputc(',', stats_fp);
+            if (stats[i].is_string == 1)
+                writeQuoted(stats_fp, stats[i].value, 1);
+            else
+                fputs(stats[i].value, stats_fp);
+        }
+        fprintf(stats_fp, "\n");
+    } else {
+        fprintf(stats_fp, "{\n  \"schema\": \"" STATS_SCHEMA "\"");
+        for (int i = 0; i < n_stats; i++) {
+            // fields of a section are adjacent
+            if (i == 0 || strcmp(stats[i].section, stats[i - 1].section)) {
+                fprintf(stats_fp, "%s,\n  \"%s\": {\n", i ? "\n  }" : "",
+                        stats[i].section);
+            } else {
+                fprintf(stats_fp, ",\n");
+            }
+            fprintf(stats_fp, "    \"%s\": ", stats[i].key);
+            if (stats[i].is_string == 2)
+                fputs("null", stats_fp);
+            else if (stats[i].is_string)
+                writeQuoted(stats_fp, stats[i].value, 0);
+            else
+                fputs(stats[i].value, stats_fp);
+        }
+        fprintf(stats_fp, "%s\n}\n", n_stats ? "\n  }" : "");
+    }
+    if (fclose(stats_fp) != 0 || rename(tmp_fn, out_fn) != 0) {
+        fprintf(stderr, "%s: %s\n", out_fn, strerror(errno));
+        unlink(tmp_fn);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * onProgressTimer - SIGALRM handler for --progress: only flags the replay
+ *   loop, which does the (non async-signal-safe) reporting.
+ */
+void onProgressTimer(int sig) {
+    (void)sig;
+    replay_events |= EVENT_PROGRESS;
+}
+
+/*
+ * onDumpSignal - SIGUSR1 handler: flag the replay loop to write a
+ *   statistics snapshot.
+ */
+void onDumpSignal(int sig) {
+    (void)sig;
+    replay_events |= EVENT_DUMP;
+}
+
+/*
+ * startProgress - Note where a replay starts and will stop, in bytes of
+ *   a text trace or in records, and start the --progress timer. Reports
+ *   are driven by the timer, so the replay loop never reads a clock.
+ */
+void startProgress(long long start, long long end, int bytes) {
+    struct sigaction sa;
+    struct itimerval it;
+
+    if (progress_secs <= 0)
+        return;
+    progress_bytes = bytes;
+    progress_start = start;
+    progress_end = end;
+    progress_start_rec = bytes ? rec_cnt : start;
+    clock_gettime(CLOCK_MONOTONIC, &progress_t0);
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = onProgressTimer;
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGALRM, &sa, NULL);
+    memset(&it, 0, sizeof(it));
+    it.it_interval.tv_sec = progress_secs;
+    it.it_value.tv_sec = progress_secs;
+    setitimer(ITIMER_REAL, &it, NULL);
+}
+
+/*
+ * reportProgress - Print the share of the trace consumed, records per
+ *   second, the estimated time left and the running miss rate to stderr.
+ */
+void reportProgress(FILE* trace_fp) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double sec = (now.tv_sec - progress_t0.tv_sec)
+                 + (now.tv_nsec - progress_t0.tv_nsec) / 1e9;
+    if (!trace_fp)
+        trace_fp = progress_fp;
+    long long pos = progress_bytes ? (long long)ftello(trace_fp) : rec_cnt;
+    double frac = progress_end > progress_start
+                  ? (double)(pos - progress_start)
+                    / (progress_end - progress_start) : 1;
+    double rate = sec > 0 ? (rec_cnt - progress_start_rec) / sec : 0;
+    long long eta = frac > 0 ? (long long)(sec / frac - sec) : -1;
+    long long accesses = (long long)(hit_cnt + miss_cnt);
+
+    fprintf(stderr, "progress: %5.1f%%  %lld records  %.0f records/s  "
+            "miss rate %.2f%%  ETA ", 100 * frac, rec_cnt, rate,
+            accesses ? 100.0 * miss_cnt / accesses : 0);
+    if (eta < 0)
+        fprintf(stderr, "?\n");
+    else
+        fprintf(stderr, "%lld:%02lld:%02lld\n", eta / 3600, eta / 60 % 60,
+                eta % 60);
+}
+
+/*
+ * handleReplayEvents - Act on the requests flagged by signal handlers.
+ *   trace_fp is the text trace being read, or NULL for a cached trace.
+ */
+void handleReplayEvents(FILE* trace_fp) {
+    int events = replay_events;
+
+    replay_events = 0;
+    if (events & EVENT_PROGRESS)
+        reportProgress(trace_fp);
+    if (events & EVENT_DUMP) {
+        // a failed snapshot must not stop the simulation
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        writeStats(dump_file, (now.tv_sec - run_start.tv_sec)
+                              + (now.tv_nsec - run_start.tv_nsec) / 1e9,
+                   0, 1);
+    }
+}
+
+/*
+ * endRecord - Save the state at --save-at and start periodic checkpoints
+ *   once a record has been simulated. trace_fp gives the byte offset of the
+ *   next record; it is NULL for a cached trace, whose records are located
+ *   by number alone.
+ */
+void endRecord(FILE* trace_fp) {
+    if (rec_cnt == save_at &&
+        saveState(save_state_file, rec_cnt,
+                  trace_fp ? (long long)ftello(trace_fp) : -1) != 0)
+        exit(1);
+
+    if (rec_cnt == next_checkpoint) {
+        checkpointInBackground(save_state_file, rec_cnt,
+                               trace_fp ? (long long)ftello(trace_fp) : -1);
+        next_checkpoint += checkpoint_every;
+    }
+
+    if (rec_cnt == next_interval) {
+        endInterval();
+        next_interval += interval_len;
+    }
+
+    if (replay_events)
+        handleReplayEvents(trace_fp);
+}
+
+/*
+ * filterInstr - Write an I line for pc to --filter-out before the data
+ *   records of a decoded trace, so that they keep their pc there. The
+ *   filters only apply to data records.
+ */
+void filterInstr(mem_addr_t pc) {
+    if (pc && pc != filter_pc)
+        fprintf(filter_fp, "I  %08llx,0\n", pc);
+    filter_pc = pc;
+}
+
+/*
+ * keepRecord - Apply the ingest filters to a data record: its op must be
+ *   one of --ops and its bytes must overlap an --addr-range. A kept record
+ *   is also written to --filter-out. Returns 0 if the record is dropped.
+ */
+int keepRecord(char op, mem_addr_t address, unsigned int len) {
+    if (filter_ops && !strchr(filter_ops, op)) {
+        filtered_cnt++;
+        return 0;
+    }
+    // G touches the whole cache, so no address range excludes it
+    if (n_ranges && op != 'G') {
+        int i;
+        for (i = 0; i < n_ranges; i++) {
+            if (address < range_hi[i] &&
+                address + (len ? len : 1) > range_lo[i])
+                break;
+        }
+        if (i == n_ranges) {
+            filtered_cnt++;
+            return 0;
+        }
+    }
+    if (filter_fp && op == 'G')
+        fprintf(filter_fp, " G\n");
+    else if (filter_fp)
+        fprintf(filter_fp, " %c %llx,%u\n", op, address, len);
+    return 1;
+}
+
+/*
+ * evictTraceCache - Remove the least recently used cached traces until
+ *   the directory holds at most --trace-cache-max bytes. Each use of a
+ *   cached trace refreshes its mtime.
+ */
+void evictTraceCache() {
+    char path[PATH_MAX];
+    struct stat st;
+    struct dirent* ent;
+
+    if (trace_cache_max < 0)
+        return;
+
+    for (;;) {
+        char oldest[PATH_MAX] = "";
+        long long oldest_ns = LLONG_MAX;
+        long long total = 0;
+        DIR* dir = opendir(trace_cache_dir);
+
+        if (!dir)
+            return;
+        while ((ent = readdir(dir)) != NULL) {
+            size_t n = strlen(ent->d_name);
+            size_t k = strlen(TRACE_CACHE_SUFFIX);
+            if (n <= k || strcmp(ent->d_name + n - k, TRACE_CACHE_SUFFIX))
+                continue;
+            snprintf(path, sizeof(path), "%s/%s", trace_cache_dir,
+                     ent->d_name);
+            if (stat(path, &st) != 0)
+                continue;
+            long long ns = st.st_mtim.tv_sec * 1000000000LL
+                           + st.st_mtim.tv_nsec;
+            total += st.st_size;
+            if (ns < oldest_ns) {
+                oldest_ns = ns;
+                strcpy(oldest, path);
+            }
+        }
+        closedir(dir);
+
+        if (total <= trace_cache_max || oldest[0] == '\0')
+            return;
+        unlink(oldest);
+    }
+}
+
+/*
+ * buildTraceCache - Parse the whole text trace once and write its records
+ *   to cache_fn, for later runs to map instead of parsing.
+ */
+void buildTraceCache(char* trace_fn, char* cache_fn, trace_cache_header_t* hdr) {
+    char buf[1000];
+    char tmp_fn[PATH_MAX];
+    trace_rec_t rec;
+    FILE* trace_fp = fopen(trace_fn, "r");
+
+    if (!trace_fp) {
+        fprintf(stderr, "%s: %s\n", trace_fn, strerror(errno));
+        exit(1);
+    }
+    snprintf(tmp_fn, sizeof(tmp_fn), "%s.%d", cache_fn, (int)getpid());
+    FILE* cache_fp = fopen(tmp_fn, "wb");
+    if (!cache_fp) {
+        fprintf(stderr, "%s: %s\n", tmp_fn, strerror(errno));
+        fclose(trace_fp);
+        return;
+    }
+
+    // the record count is filled in once the trace has been read
+    hdr->n_recs = 0;
+    fwrite(hdr, sizeof(*hdr), 1, cache_fp);
+    memset(&rec, 0, sizeof(rec));
+    while (fgets(buf, 1000, trace_fp) != NULL) {
+        if (isRecordOp(buf[1])) {
+            rec.op = buf[1];
+            parseOperands(buf, &rec.addr, &rec.len);
+            fwrite(&rec, sizeof(rec), 1, cache_fp);
+            hdr->n_recs++;
+        }
+    }
+    fclose(trace_fp);
+
+    rewind(cache_fp);
+    if (fwrite(hdr, sizeof(*hdr), 1, cache_fp) != 1 ||
+        fclose(cache_fp) != 0 || rename(tmp_fn, cache_fn) != 0) {
+        // the run still works without the cache
+        fprintf(stderr, "%s: %s\n", cache_fn, strerror(errno));
+        unlink(tmp_fn);
+        return;
+    }
+    evictTraceCache();
+}
+
+/*
+ * replayCached - Replay the decoded copy of the trace kept in
+ *   --trace-cache, creating it first if needed. The copy is keyed by the
+ *   trace's path, size and mtime, and checked against its content
+ *   fingerprint. Returns 0 if there is no usable copy, in which case the
+ *   caller parses the text trace. The copy keeps no I lines, so it is not
+ *   used when pcs are needed or --filter-out passes them on.
+ */
+int replayCached(char* trace_fn, long long end_rec) {
+    char real_fn[PATH_MAX];
+    char cache_fn[PATH_MAX];
+    struct stat st;
+    trace_cache_header_t hdr;
+    trace_cache_header_t* cached;
+    int fd = open(trace_fn, O_RDONLY);
+
+    if (fd < 0 || fstat(fd, &st) != 0 || !realpath(trace_fn, real_fn)) {
+        fprintf(stderr, "%s: %s\n", trace_fn, strerror(errno));
+        exit(1);
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, TRACE_CACHE_MAGIC, sizeof(TRACE_CACHE_MAGIC));
+    hdr.version = TRACE_CACHE_VERSION;
+    hdr.trace_size = st.st_size;
+    hdr.trace_mtime_ns = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    hdr.fingerprint = fingerprintFile(fd, st.st_size);
+    close(fd);
+
+    unsigned long long key = hashBytes(HASH_INIT, real_fn, strlen(real_fn));
+    key = hashBytes(key, &hdr.trace_size, sizeof(hdr.trace_size));
+    key = hashBytes(key, &hdr.trace_mtime_ns, sizeof(hdr.trace_mtime_ns));
+    snprintf(cache_fn, sizeof(cache_fn), "%s/%016llx" TRACE_CACHE_SUFFIX,
+             trace_cache_dir, key);
+
+    for (int tries = 0; tries < 2; tries++) {
+        fd = open(cache_fn, O_RDONLY);
+        if (fd >= 0 && fstat(fd, &st) == 0 &&
+            st.st_size >= (off_t)sizeof(hdr)) {
+            cached = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (cached != MAP_FAILED) {
+                if (memcmp(cached, &hdr, offsetof(trace_cache_header_t,
+                                                  n_recs)) == 0 &&
+                    st.st_size == (off_t)(sizeof(hdr) +
+                                          cached->n_recs * sizeof(trace_rec_t)))
+                    break;
+                munmap(cached, st.st_size);
+            }
+        }
+        if (fd >= 0)
+            close(fd);
+        fd = -1;
+        if (tries == 0)
+            buildTraceCache(trace_fn, cache_fn, &hdr);
+    }
+    if (fd < 0)
+        return 0;
+
+    // mark the copy as recently used for eviction
+    futimens(fd, NULL);
+    close(fd);
+
+    trace_rec_t* recs = (trace_rec_t*)(cached + 1);
+    long long n = cached->n_recs;
+    madvise(cached, st.st_size, MADV_SEQUENTIAL);
+
+    // records are fixed size, so skipping is just an index
+    if (rec_cnt < skip_to)
+        rec_cnt = skip_to < n ? skip_to : n;
+    if (end_rec >= 0 && end_rec < n)
+        n = end_rec;
+    startProgress(rec_cnt, n, 0);
+    while (rec_cnt < n) {
+        // copying the record is where the mapped pages are read in
+        trace_rec_t r = recs[rec_cnt++];
+        if (profiling)
+            profStage(PROF_IO);
+        if (filtering && !keepRecord(r.op, r.addr, r.len)) {
+            endRecord(NULL);
+            continue;
+        }
+        replayRecord(r.op, r.addr, r.len);
+        endRecord(NULL);
+        if (profiling)
+            profStage(PROF_OTHER);
+    }
+
+    munmap(cached, st.st_size);
+    return 1;
+}
+
+/*
+ * replayText - Replay a lackey text trace, starting at byte offset start
+ *   (record rec_cnt) and stopping before record end_rec. Returns the byte
+ *   offset of the first record not simulated.
+ */
+long long replayText(char* trace_fn, long long start, long long end_rec) {
+    char buf[1000];  // char array to hold each line in file
+    mem_addr_t address = 0;  // the address on each line
+    unsigned int len = 0;  // length of each line
+    FILE* trace_fp = fopen(trace_fn, "r");  // the initialized input file
+
+    // if there is an error opening the file, print error message
+    if (!trace_fp) {
+        fprintf(stderr, "%s: %s\n", trace_fn, strerror(errno));
+        exit(1);
+    }
+
+    if (fseeko(trace_fp, (off_t)start, SEEK_SET) != 0) {
+        fprintf(stderr, "%s: %s\n", trace_fn, strerror(errno));
+        exit(1);
+    }
+
+    // seek over the skipped records instead of reading through them
+    if (use_index && skip_to - rec_cnt >= INDEX_STRIDE) {
+        long long rec = seekRecord(trace_fp, trace_fn, skip_to, NULL);
+        if (rec > rec_cnt)
+            rec_cnt = rec;
+        else
+            fseeko(trace_fp, (off_t)start, SEEK_SET);
+    }
+
+    // a --limit window is measured in records, a whole trace in bytes
+    if (end_rec >= 0) {
+        startProgress(rec_cnt > skip_to ? rec_cnt : skip_to, end_rec, 0);
+    } else {
+        struct stat st;
+        fstat(fileno(trace_fp), &st);
+        startProgress((long long)ftello(trace_fp), st.st_size, 1);
+    }
+
+    // loop through file line by line
+    while (fgets(buf, 1000, trace_fp) != NULL) {
+        if (profiling)
+            profStage(PROF_IO);
+        if (isRecordOp(buf[1])) {
+            if (rec_cnt == end_rec) {
+                // leave the stream at the record that was not simulated
+                fseeko(trace_fp, -(off_t)strlen(buf), SEEK_CUR);
+                break;
+            }
+
+            // records before --skip-to are counted but not simulated
+            if (rec_cnt++ < skip_to)
+                continue;
+
+            // dropped ops are not even parsed
+            if (filter_ops && !strchr(filter_ops, buf[1])) {
+                filtered_cnt++;
+                endRecord(trace_fp);
+                continue;
+            }
+            parseOperands(buf, &address, &len);
+            if (profiling)
+                profStage(PROF_PARSE);
+            if (filtering && !keepRecord(buf[1], address, len)) {
+                endRecord(trace_fp);
+                continue;
+            }
+            replayRecord(buf[1], address, len);
+            endRecord(trace_fp);
+            if (profiling)
+                profStage(PROF_OTHER);
+        } else if (buf[0] == 'I') {
+            // the data accesses that follow belong to this instruction
+            if (need_pc)
+                cur_pc = strtoull(buf + 2, NULL, 16);
+            if (filter_fp && rec_cnt >= skip_to)
+                fputs(buf, filter_fp);
+        }
+    }
+
+    long long offset = (long long)ftello(trace_fp);
+    fclose(trace_fp);
+    return offset;
+}
+
+/*
+ * replayRecords - Replay a binary trace through its format's reader,
+ *   READ_BATCH records at a time, stopping before record end_rec. Records
+ *   before --skip-to are decoded but not simulated.
+ */
+void replayRecords(char* trace_fn, long long end_rec) {
+    static access_rec_t recs[READ_BATCH];
+    trace_reader_t rd;
+    struct stat st;
+    int n;
+
+    openReader(&rd, trace_fn);
+    if (fstat(fileno(rd.fp), &st) != 0) {
+        fprintf(stderr, "%s: %s\n", trace_fn, strerror(errno));
+        exit(1);
+    }
+    // seek to the window: a raw record is at a fixed offset, and the
+    // other formats need the index
+    if (trace_format == FORMAT_RAW && skip_to > 0) {
+        if (fseeko(rd.fp, (off_t)skip_to * RAW_ENTRY, SEEK_SET) == 0)
+            rec_cnt = skip_to;
+    } else if (use_index && skip_to >= INDEX_STRIDE) {
+        rec_cnt = seekRecord(rd.fp, trace_fn, skip_to, &rd);
+    } else if (skip_to >= INDEX_STRIDE) {
+        fprintf(stderr, "Warning: reading %lld %s records to skip them; "
+                "--index seeks instead\n", skip_to,
+                format_names[trace_format]);
+    }
+    progress_fp = rd.fp;
+    startProgress(0, st.st_size, 1);
+
+    while (rec_cnt != end_rec && (n = rd.decode(&rd, recs, READ_BATCH)) > 0) {
+        if (profiling)
+            profStage(PROF_PARSE);
+        for (int i = 0; i < n && rec_cnt != end_rec; i++) {
+            access_rec_t* r = &recs[i];
+
+            if (rec_cnt++ < skip_to)
+                continue;
+            if (filter_fp)
+                filterInstr(r->pc);
+            if (filtering && !keepRecord(r->op, r->addr, r->len)) {
+                endRecord(NULL);
+                continue;
+            }
+            cur_pc = r->pc;
+            cur_thread = r->thread;
+            replayRecord(r->op, r->addr, r->len);
+            endRecord(NULL);
+            if (profiling)
+                profStage(PROF_OTHER);
+        }
+    }
+
+    progress_fp = NULL;
+    fclose(rd.fp);
+}
+
+/*
+ * replayTrace - replays the given trace file against the cache
+ * reads the input trace file line by line, or the decoded copy kept
+ * under --trace-cache, or decodes a --trace-format binary trace
+ * extracts the type of each memory access : L/S/M
+ * With --restore, the cache state is loaded first and replay continues
+ * from the saved trace position; records before --skip-to are read but
+ * not simulated, unless --index lets replay seek close to them. Replay
+ * stops after --limit records.
+ */
+void replayTrace(char* trace_fn) {
+    long long offset = 0;
+
+    // the window ends --limit records after --skip-to
+    long long end_rec = rec_limit < 0 ? -1
+                        : (skip_to > 0 ? skip_to : 0) + rec_limit;
+
+    // continue from a checkpoint instead of re-warming the cache
+    if (restore_file) {
+        offset = restoreState(restore_file, &rec_cnt);
+        if (skip_to >= 0 && skip_to < rec_cnt) {
+            fprintf(stderr, "%s: checkpoint is at record %lld, past "
+                    "--skip-to %lld\n", restore_file, rec_cnt, skip_to);
+            exit(1);
+        }
+    }
+
+    // periodic checkpoints are counted from where this run starts
+    if (checkpoint_every > 0)
+        next_checkpoint = (rec_cnt > skip_to ? rec_cnt : skip_to)
+                          + checkpoint_every;
+
+    // intervals are aligned to record numbers, so restored runs line up
+    if (interval_len > 0) {
+        long long first = rec_cnt > skip_to ? rec_cnt : skip_to;
+        next_interval = (first / interval_len + 1) * interval_len;
+        interval_cnt = first / interval_len;
+    }
+
+    restored_accesses = hit_cnt + miss_cnt;
+    if (trace_format != FORMAT_LACKEY) {
+        // binary records are located by number: read up to a checkpoint
+        if (skip_to < rec_cnt)
+            skip_to = rec_cnt;
+        rec_cnt = 0;
+        replayRecords(trace_fn, end_rec);
+        offset = -1;
+    } else if (trace_cache_dir && !need_pc && !filter_fp &&
+               replayCached(trace_fn, end_rec)) {
+        offset = -1;
+    } else {
+        // a checkpoint saved from a cached replay has no byte offset, so
+        // read up to its record instead
+        if (offset < 0) {
+            if (skip_to < rec_cnt)
+                skip_to = rec_cnt;
+            rec_cnt = 0;
+            offset = 0;
+        }
+        offset = replayText(trace_fn, offset, end_rec);
+    }
+    replay_accesses = hit_cnt + miss_cnt - restored_accesses;
+
+    // let a background save finish before the final state replaces it
+    waitCheckpoint(1);
+
+    // without --save-at the final state is saved
+    if (save_state_file && save_at < 0 &&
+        saveState(save_state_file, rec_cnt, offset) != 0)
+        exit(1);
+}
+
+/*
+ * corunPeek - Make sure src has a buffered record, reading its next
+ *   batch if needed. Returns 0 once its trace has ended.
+ */
+int corunPeek(corun_src_t* src) {
+    if (src->pos < src->n)
+        return 1;
+    if (src->done)
+        return 0;
+    src->n = src->rd.decode(&src->rd, src->buf, READ_BATCH);
+    src->pos = 0;
+    if (profiling)
+        profStage(PROF_PARSE);
+    if (src->n == 0) {
+        src->done = 1;
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * corunNext - Pick the source of the next co-run record: the current
+ *   source until its turn is used up, or with --interleave time the one
+ *   whose next record is earliest. Returns NULL when every trace ended.
+ */
+corun_src_t* corunNext() {
+    static int turn = 0;
+    corun_src_t* next = NULL;
+
+    if (interleave == INTERLEAVE_TIME) {
+        // ties go to the source that has issued the fewest records
+        for (int i = 0; i < n_sources; i++) {
+            corun_src_t* src = &sources[i];
+            if (corunPeek(src) &&
+                (!next || src->buf[src->pos].time < next->buf[next->pos].time
+                 || (src->buf[src->pos].time == next->buf[next->pos].time &&
+                     src->issued < next->issued)))
+                next = src;
+        }
+        return next;
+    }
+
+    // a source that has ended gives its turn to the next one
+    for (int i = 0; i <= n_sources; i++) {
+        corun_src_t* src = &sources[turn];
+        if (src->left > 0 && corunPeek(src)) {
+            src->left--;
+            return src;
+        }
+        turn = (turn + 1) % n_sources;
+        sources[turn].left = sources[turn].quantum;
+    }
+    return NULL;
+}
+
+/*
+ * allocSources - Allocate the counters of the co-run sources, with
+ *   trace_fn as source 0.
+ */
+void allocSources(char* trace_fn) {
+    source_files[0] = trace_fn;
+    sources = calloc(n_sources, sizeof(corun_src_t));
+    cross_evict = calloc(n_sources * n_sources, sizeof(long long));
+    if (!sources || !cross_evict) {
+        printf("Cannot malloc co-run sources\n");
+        exit(1);
+    }
+    for (int i = 0; i < n_sources; i++)
+        sources[i].trace_fn = source_files[i];
+}
+
+/*
+ * replayCorun - Replay trace_fn and the --corun traces into the one cache,
+ *   interleaved by --interleave. Every source streams through its own
+ *   reader, READ_BATCH records at a time. Each fill records the source
+ *   that made it, so an eviction can be charged to the pair of sources.
+ *   Replay stops after --limit records in all.
+ */
+void replayCorun(char* trace_fn) {
+    corun_src_t* src;
+
+    allocSources(trace_fn);
+    for (int i = 0; i < n_sources; i++) {
+        src = &sources[i];
+        openReader(&src->rd, src->trace_fn);
+        src->buf = malloc(READ_BATCH * sizeof(access_rec_t));
+        if (!src->buf) {
+            printf("Cannot malloc co-run buffer\n");
+            exit(1);
+        }
+        src->quantum = quanta[i] > 0 ? quanta[i] : 1;
+    }
+    sources[0].left = sources[0].quantum;
+
+    // progress follows --limit, or else the first trace
+    if (rec_limit >= 0) {
+        startProgress(0, rec_limit, 0);
+    } else {
+        struct stat st;
+        if (fstat(fileno(sources[0].rd.fp), &st) == 0) {
+            progress_fp = sources[0].rd.fp;
+            startProgress(0, st.st_size, 1);
+        }
+    }
+
+    while (rec_cnt != rec_limit && (src = corunNext()) != NULL) {
+        access_rec_t* r = &src->buf[src->pos++];
+        unsigned long long hits0 = hit_cnt, misses0 = miss_cnt,
+                           evicts0 = evict_cnt;
+
+        rec_cnt++;
+        if (filter_fp)
+            filterInstr(r->pc);
+        if (filtering && !keepRecord(r->op, r->addr, r->len)) {
+            endRecord(NULL);
+            continue;
+        }
+        cur_source = src - sources;
+        cur_pc = r->pc;
+        cur_thread = r->thread;
+        replayRecord(r->op, r->addr, r->len);
+        src->issued++;
+        src->hits += hit_cnt - hits0;
+        src->misses += miss_cnt - misses0;
+        src->evicts += evict_cnt - evicts0;
+        endRecord(NULL);
+        if (profiling)
+            profStage(PROF_OTHER);
+    }
+
+    progress_fp = NULL;
+    for (int i = 0; i < n_sources; i++) {
+        fclose(sources[i].rd.fp);
+        free(sources[i].buf);
+    }
+    replay_accesses = hit_cnt + miss_cnt;
+}
+
+/*
+ * replay - Replay the trace, alone or with its --corun sources.
+ */
+void replay(char* trace_fn) {
+    if (n_sources > 1)
+        replayCorun(trace_fn);
+    else
+        replayTrace(trace_fn);
+}
+
+/*
+ * appendStore - Append a line of len bytes to --results-store. It is a
+ *   single write to a file opened with O_APPEND under an exclusive lock,
+ *   so concurrent runs never interleave lines.
+ */
+void appendStore(char* line, int len) {
+    int fd = open(results_store, O_WRONLY | O_APPEND | O_CREAT, 0644);
+
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s\n", results_store, strerror(errno));
+        return;
+    }
+    flock(fd, LOCK_EX);
+    if (write(fd, line, len) != len)
+        fprintf(stderr, "%s: %s\n", results_store, strerror(errno));
+    flock(fd, LOCK_UN);
+    close(fd);
+}
+
+/*
+ * traceHash - The hash of the full content of trace file trace_fn. The
+ *   results store keeps it under the trace's device, inode, size and
+ *   mtime, so only the first run on a trace reads all of it.
+ */
+unsigned long long traceHash(char* trace_fn) {
+    static char line[16384];
+    char id[128];
+    unsigned long long h = 0;
+    struct stat st;
+    int found = 0;
+    int fd = open(trace_fn, O_RDONLY);
+
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "%s: %s\n", trace_fn, strerror(errno));
+        exit(1);
+    }
+    // lines are "trace <device>:<inode> <size> <mtime> | <hash>"
+    int n = snprintf(id, sizeof(id), "trace %llu:%llu %lld %lld | ",
+                     (unsigned long long)st.st_dev,
+                     (unsigned long long)st.st_ino, (long long)st.st_size,
+                     st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec);
+    FILE* store_fp = fopen(results_store, "r");
+    while (store_fp && !found && fgets(line, sizeof(line), store_fp))
+        found = strncmp(line, id, n) == 0 &&
+                sscanf(line + n, "%llx", &h) == 1;
+    if (store_fp)
+        fclose(store_fp);
+    if (!found) {
+        h = hashFile(fd, st.st_size);
+        appendStore(line, snprintf(line, sizeof(line), "%s%016llx\n", id,
+                                   h));
+    }
+    close(fd);
+    return h;
+}
+
+/*
+ * resultKey - Describe everything that determines the counters of this
+ *   run: the trace's content hash, the geometry, the replacement
+ *   policy and the options that change which records are simulated.
+ *   Returns 0 if the run cannot be memoized.
+ */
+int resultKey(char* key, size_t size) {
+    // a restored or checkpointing run depends on more than its options,
+    // and the analyses and host measurements need the replay itself
+    if (restore_file || save_state_file || verbosity || event_log ||
+        lifetimes || classify || footprint || reuse_profile || filter_out ||
+        profiling || perf_counters)
+        return 0;
+
+    int n = snprintf(key, size, "%016llx s=%d E=%d b=%d policy=%s "
+                     "skip=%lld limit=%lld", traceHash(trace_file),
+                     s, E, b, policy_name, skip_to < 0 ? 0 : skip_to,
+                     rec_limit);
+    if (trace_format != FORMAT_LACKEY)
+        n += snprintf(key + n, size - n, " format=%s",
+                      format_names[trace_format]);
+    if (filter_ops)
+        n += snprintf(key + n, size - n, " ops=%s", filter_ops);
+    for (int i = 0; i < n_tenants && n < (int)size; i++)
+        n += snprintf(key + n, size - n, " cat=%llx:%d:%d:%llx-%llx",
+                      tenants[i].mask, tenants[i].thread, tenants[i].source,
+                      tenants[i].lo, tenants[i].hi);
+    if (partitioned && n < (int)size)
+        n += snprintf(key + n, size - n, " cat=%llx", other_tenant.mask);
+    for (int i = 0; i < n_ranges && n < (int)size; i++)
+        n += snprintf(key + n, size - n, " range=%llx-%llx", range_lo[i],
+                      range_hi[i]);
+    // co-run sources, in order, and how they take turns
+    for (int i = 1; i < n_sources && n < (int)size; i++)
+        n += snprintf(key + n, size - n, " corun=%016llx",
+                      traceHash(source_files[i]));
+    if (n_sources > 1 && interleave == INTERLEAVE_TIME && n < (int)size) {
+        n += snprintf(key + n, size - n, " interleave=time");
+    } else if (n_sources > 1 && n < (int)size) {
+        n += snprintf(key + n, size - n, " interleave=");
+        for (int i = 0; i < n_sources && n < (int)size; i++)
+            n += snprintf(key + n, size - n, "%s%lld", i ? "," : "",
+                          quanta[i] > 0 ? quanta[i] : 1);
+    }
+    return n < (int)size;
+}
+
+/*
+ * resultCounters - Point counters[] at what a stored result keeps
+ *   besides hits, misses and evictions: everything the reports and
+ *   --stats-out print about a run. Returns their number.
+ */
+int resultCounters(long long** counters) {
+    static long long* fixed[] = { &rec_cnt, &filtered_cnt, &bypass_cnt,
+                                  &invalidate_cnt, &flush_cnt,
+                                  &global_inval_cnt };
+    int n = 0;
+
+    for (size_t i = 0; i < sizeof(fixed) / sizeof(fixed[0]); i++)
+        counters[n++] = fixed[i];
+    for (int i = 0; i <= n_tenants && partitioned; i++) {
+        tenant_t* t = i < n_tenants ? &tenants[i] : &other_tenant;
+        counters[n++] = &t->hits;
+        counters[n++] = &t->misses;
+        counters[n++] = &t->evicts;
+    }
+    for (int i = 0; i < n_sources && sources; i++) {
+        counters[n++] = &sources[i].issued;
+        counters[n++] = &sources[i].hits;
+        counters[n++] = &sources[i].misses;
+        counters[n++] = &sources[i].evicts;
+    }
+    for (int i = 0; i < n_sources * n_sources && sources; i++)
+        counters[n++] = &cross_evict[i];
+    return n;
+}
+
+#define MAX_RESULT_COUNTERS \
+    (6 + 3 * (MAX_TENANTS + 1) + (4 + MAX_SOURCES) * MAX_SOURCES)
+
+/*
+ * lookupResult - Find the counters stored for key in --results-store and
+ *   load them. The last matching line wins. Returns non-zero if one was
+ *   found.
+ */
+int lookupResult(char* key) {
+    static char line[16384];
+    long long* counters[MAX_RESULT_COUNTERS];
+    long long values[MAX_RESULT_COUNTERS];
+    size_t n = strlen(key);
+    int found = 0;
+    unsigned long long hits, misses, evicts;
+    char* p;
+    FILE* store_fp = fopen(results_store, "r");
+
+    if (!store_fp)
+        return 0;
+    if (n_sources > 1 && !sources)
+        allocSources(trace_file);
+    int n_counters = resultCounters(counters);
+
+    // lines are "<key> | <hits> <misses> <evictions> | <counters>"; a line
+    // from an older csim, without the counters, is run again
+    while (fgets(line, sizeof(line), store_fp) != NULL) {
+        if (strncmp(line, key, n) != 0 || strncmp(line + n, " | ", 3) != 0 ||
+            sscanf(line + n + 3, "%llu %llu %llu", &hits, &misses,
+                   &evicts) != 3 ||
+            (p = strstr(line + n + 3, " | ")) == NULL)
+            continue;
+        p += 2;
+        int i;
+        for (i = 0; i < n_counters; i++) {
+            char* end;
+            values[i] = strtoll(p, &end, 10);
+            if (end == p)
+                break;
+            p = end;
+        }
+        if (i < n_counters)
+            continue;
+        for (i = 0; i < n_counters; i++)
+            *counters[i] = values[i];
+        hit_cnt = hits;
+        miss_cnt = misses;
+        evict_cnt = evicts;
+        found = 1;
+    }
+    fclose(store_fp);
+    return found;
+}
+
+/*
+ * storeResult - Append the counters for key to --results-store.
+ */
+void storeResult(char* key) {
+    static char line[16384];
+    long long* counters[MAX_RESULT_COUNTERS];
+    int n_counters = resultCounters(counters);
+    int len = snprintf(line, sizeof(line), "%s | %llu %llu %llu |", key,
+                       hit_cnt, miss_cnt, evict_cnt);
+
+    for (int i = 0; i < n_counters && len < (int)sizeof(line); i++)
+        len += snprintf(line + len, sizeof(line) - len, " %lld",
+                        *counters[i]);
+    if (len < (int)sizeof(line))
+        len += snprintf(line + len, sizeof(line) - len, "\n");
+    if (len >= (int)sizeof(line)) {
+        fprintf(stderr, "%s: result too long to store\n", results_store);
+        return;
+    }
+    appendStore(line, len);
+}
+
+/*
+ * profReport - Print the time spent in each stage, the simulation rate
+ *   and the peak memory footprint. start_ns/start_tick were taken when
+ *   the run began; ticks are converted using the elapsed monotonic time.
+ */
+void profReport(long long start_ns, unsigned long long start_tick) {
+    static const char* names[PROF_STAGES] = { "io", "parse", "access",
+                                              "output", "other" };
+    struct timespec ts;
+    struct rusage ru;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    double wall = (ts.tv_sec * 1000000000LL + ts.tv_nsec - start_ns) / 1e9;
+    double ticks = (double)(profTick() - start_tick);
+    double sec_per_tick = ticks > 0 ? wall / ticks : 0;
+
+    // time outside any stage (setup, teardown) counts as other
+    prof_ticks[PROF_OTHER] = 0;
+    for (int i = 0; i < PROF_OTHER; i++)
+        prof_ticks[PROF_OTHER] += prof_ticks[i];
+    prof_ticks[PROF_OTHER] = ticks > prof_ticks[PROF_OTHER]
+                             ? ticks - prof_ticks[PROF_OTHER] : 0;
+
+    printf("profile: wall:%.3fs", wall);
+    for (int i = 0; i < PROF_STAGES; i++) {
+        double t = prof_ticks[i] * sec_per_tick;
+        printf(" %s:%.3fs(%.1f%%)", names[i], t,
+               wall > 0 ? 100 * t / wall : 0);
+    }
+    printf("\n");
+
+    getrusage(RUSAGE_SELF, &ru);
+    printf("profile: records:%lld accesses:%lld records/s:%.0f "
+           "ns/access:%.1f peak-rss:%ldKiB\n", prof_records, replay_accesses,
+           wall > 0 ? prof_records / wall : 0,
+           replay_accesses ? prof_ticks[PROF_ACCESS] * sec_per_tick * 1e9
+                             / replay_accesses : 0,
+           ru.ru_maxrss);
+}
+
+/*
+ * perfStart - Open and start the host counters with perf_event_open().
+ *   The events form one group under the first that opens, so they count
+ *   over the same time even when the PMU multiplexes them. An event the
+ *   host lacks (e.g. no dTLB event in a VM) is left out of the group.
+ */
+void perfStart() {
+#ifdef __linux__
+    static const struct { unsigned type; unsigned long long config; }
+    events[PERF_EVENTS] = {
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+        { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB
+                              | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                              | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    };
+    struct perf_event_attr attr;
+
+    perf_leader = -1;
+    for (int i = 0; i < PERF_EVENTS; i++) {
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = events[i].type;
+        attr.config = events[i].config;
+        // the members start and stop with the leader
+        attr.disabled = perf_leader < 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP |
+                           PERF_FORMAT_TOTAL_TIME_ENABLED |
+                           PERF_FORMAT_TOTAL_TIME_RUNNING;
+        perf_fd[i] = syscall(SYS_perf_event_open, &attr, 0, -1, perf_leader,
+                             0);
+        if (perf_fd[i] >= 0 && perf_leader < 0)
+            perf_leader = perf_fd[i];
+    }
+    if (perf_leader >= 0) {
+        ioctl(perf_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(perf_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+#else
+    for (int i = 0; i < PERF_EVENTS; i++)
+        perf_fd[i] = -1;
+#endif
+}
+
+/*
+ * perfStop - Stop the host counters and read their values, scaled up by
+ *   the share of the time the group was actually counting.
+ */
+void perfStop() {
+    for (int i = 0; i < PERF_EVENTS; i++)
+        perf_val[i] = -1;
+#ifdef __linux__
+    // { nr, time enabled, time running, the members in the order opened }
+    unsigned long long group[3 + PERF_EVENTS];
+    if (perf_leader >= 0) {
+        ioctl(perf_leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        ssize_t n = read(perf_leader, group, sizeof(group));
+        if (n >= (ssize_t)(3 * sizeof(group[0])) && group[2] > 0) {
+            perf_scale = (double)group[1] / group[2];
+            for (unsigned long long i = 0, k = 0;
+                 i < PERF_EVENTS && k < group[0]; i++)
+                if (perf_fd[i] >= 0)
+                    perf_val[i] = (long long)(group[3 + k++] * perf_scale);
+        }
+    }
+    for (int i = 0; i < PERF_EVENTS; i++)
+        if (perf_fd[i] >= 0)
+            close(perf_fd[i]);
+#endif
+}
+
+/*
+ * perfReport - Print the host counters with IPC and misses per simulated
+ *   access. Events that could not be opened print as n/a.
+ */
+void perfReport() {
+    static const char* names[PERF_EVENTS] = { "cycles", "instructions",
+        "llc-misses", "dtlb-misses", "branch-misses" };
+    long long* val = perf_val;
+
+    printf("perf:");
+    for (int i = 0; i < PERF_EVENTS; i++) {
+        if (val[i] < 0)
+            printf(" %s:n/a", names[i]);
+        else
+            printf(" %s:%lld", names[i], val[i]);
+    }
+    printf("\n");
+    if (perf_scale > 1.0001)
+        printf("perf: multiplexed: counted %.1f%% of the time, values "
+               "scaled\n", 100 / perf_scale);
+
+    printf("perf: ipc:");
+    if (val[PERF_CYCLES] > 0 && val[PERF_INSTRUCTIONS] >= 0)
+        printf("%.2f", (double)val[PERF_INSTRUCTIONS] / val[PERF_CYCLES]);
+    else
+        printf("n/a");
+    printf(" per-access:");
+    for (int i = 0; i < PERF_EVENTS; i++) {
+        if (val[i] >= 0 && replay_accesses > 0)
+            printf(" %s:%.3f", names[i], (double)val[i] / replay_accesses);
+    }
+    printf("\n");
+}
+
+/*
+ * mix64 - splitmix64 step: advance *state and return a well-mixed value.
+ *   Used as the deterministic generator behind --gen and --bench.
+ */
+unsigned long long mix64(unsigned long long* state) {
+    unsigned long long z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/*
+ * genTrace - Fill recs with n records of the given synthetic pattern.
+ *   The same kind and seed always produce the same records.
+ *     seq:       8-byte steps through 64 MiB, one store in four
+ *     stride:    1 KiB steps through 16 MiB
+ *     random:    uniform 8-byte accesses in 64 MiB, one store in four
+ *     zipf:      Zipf(0.99) popularity over 64K scattered blocks
+ *     chase:     a pointer chase around a random cycle of 256K nodes
+ *     transpose: naive 64x64 int matrix transpose, as in CS:APP
+ */
+void genTrace(int kind, long long n, trace_rec_t* recs) {
+    unsigned long long state = seed;
+    double* cdf = NULL;
+    unsigned int* next = NULL;
+    unsigned int node = 0;
+    int nitems = 1 << 16;
+    int nnodes = 1 << 18;
+
+    if (kind == GEN_ZIPF) {
+        // cumulative distribution, searched per access
+        cdf = malloc(nitems * sizeof(double));
+        double sum = 0;
+        for (int i = 0; i < nitems; i++)
+            cdf[i] = (sum += 1.0 / pow(i + 1, 0.99));
+        for (int i = 0; i < nitems; i++)
+            cdf[i] /= sum;
+    }
+    if (kind == GEN_CHASE) {
+        // Sattolo's shuffle gives a single cycle through every node
+        next = malloc(nnodes * sizeof(unsigned int));
+        for (int i = 0; i < nnodes; i++)
+            next[i] = i;
+        for (int i = nnodes - 1; i > 0; i--) {
+            int j = mix64(&state) % i;
+            unsigned int t = next[i];
+            next[i] = next[j];
+            next[j] = t;
+        }
+    }
+    if ((kind == GEN_ZIPF && !cdf) || (kind == GEN_CHASE && !next)) {
+        printf("Cannot malloc trace generator.");
+        exit(1);
+    }
+
+    for (long long i = 0; i < n; i++) {
+        trace_rec_t* r = &recs[i];
+        r->op = 'L';
+        r->len = 8;
+        switch (kind) {
+            case GEN_SEQ:
+                r->addr = (i * 8) & ((1 << 26) - 1);
+                if (i % 4 == 3)
+                    r->op = 'S';
+                break;
+            case GEN_STRIDE:
+                r->addr = (i * 1024) & ((1 << 24) - 1);
+                break;
+            case GEN_RANDOM: {
+                unsigned long long x = mix64(&state);
+                r->addr = x & ((1 << 26) - 8);
+                if ((x >> 40) % 4 == 3)
+                    r->op = 'S';
+                break;
+            }
+            case GEN_ZIPF: {
+                double u = (mix64(&state) >> 11) * (1.0 / (1ULL << 53));
+                int lo = 0, hi = nitems - 1;
+                while (lo < hi) {
+                    int mid = (lo + hi) / 2;
+                    if (cdf[mid] < u)
+                        lo = mid + 1;
+                    else
+                        hi = mid;
+                }
+                // scatter the popular items across the sets
+                r->addr = (((mem_addr_t)lo * 0x9e3779b1U) & ((1 << 20) - 1))
+                          * 64;
+                break;
+            }
+            case GEN_CHASE:
+                node = next[node];
+                r->addr = (mem_addr_t)node * 64;
+                break;
+            case GEN_TRANSPOSE: {
+                // B[j][i] = A[i][j]: a load from A then a store to B
+                long long k = (i / 2) % (64 * 64);
+                int row = k / 64, col = k % 64;
+                r->len = 4;
+                if (i % 2 == 0) {
+                    r->addr = 0x100000 + (row * 64 + col) * 4;
+                } else {
+                    r->op = 'S';
+                    r->addr = 0x200000 + (col * 64 + row) * 4;
+                }
+                break;
+            }
+        }
+    }
+    free(cdf);
+    free(next);
+}
+
+/*
+ * genKind - Look up a --gen pattern by name, or return -1.
+ */
+int genKind(char* name) {
+    for (int i = 0; i < GEN_KINDS; i++) {
+        if (strcmp(name, gen_names[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+/*
+ * writeGenTrace - Write a synthetic trace to stdout in lackey format.
+ */
+void writeGenTrace(int kind) {
+    trace_rec_t* recs = malloc(gen_length * sizeof(trace_rec_t));
+
+    if (!recs) {
+        printf("Cannot malloc trace generator.");
+        exit(1);
+    }
+    genTrace(kind, gen_length, recs);
+    for (long long i = 0; i < gen_length; i++)
+        printf(" %c %llx,%u\n", recs[i].op, recs[i].addr, recs[i].len);
+    free(recs);
+}
+
+/*
+ * sampleWeighted - Pick an index in [0, n) with probability proportional
+ *   to w[i]. Returns -1 if all weights are zero.
+ */
+int sampleWeighted(long long* w, int n, unsigned long long* state) {
+    long long total = 0;
+
+    for (int i = 0; i < n; i++)
+        total += w[i];
+    if (total == 0)
+        return -1;
+    long long r = mix64(state) % total;
+    for (int i = 0; i < n; i++) {
+        if (r < w[i])
+            return i;
+        r -= w[i];
+    }
+    return n - 1;
+}
+
+/*
+ * writeProfileTrace - Generate --gen-length records whose op mix, sizes,
+ *   reuse-distance histogram and layout of new data follow the profile
+ *   written by --reuse-profile, and write them to stdout as a lackey
+ *   trace. A reuse of distance d re-accesses the block d places down the
+ *   generator's own LRU stack, so an LRU cache of any size sees the same
+ *   miss rate as on the measured trace.
+ */
+void writeProfileTrace(char* prof_fn) {
+    char key[32];
+    long long v1, v2, v3;
+    int bits = 6;
+    long long ops[3] = { 0 }, lens[17] = { 0 };
+    long long reuse[LIFE_BUCKETS + 1] = { 0 };  // last slot: cold
+    long long cls[CLASSES] = { 0 };
+    int nstride = 0;
+    int version;
+    FILE* prof_fp = fopen(prof_fn, "r");
+
+    if (!prof_fp) {
+        fprintf(stderr, "%s: %s\n", prof_fn, strerror(errno));
+        exit(1);
+    }
+    if (fscanf(prof_fp, "%31s %d", key, &version) != 2 ||
+        strcmp(key, PROFILE_MAGIC) != 0) {
+        fprintf(stderr, "%s: not a reuse profile\n", prof_fn);
+        exit(1);
+    }
+    if (version != PROFILE_VERSION) {
+        fprintf(stderr, "%s: reuse profile version %d, expected %d\n",
+                prof_fn, version, PROFILE_VERSION);
+        exit(1);
+    }
+    n_strides = 0;
+    while (fscanf(prof_fp, "%31s", key) == 1) {
+        if (strcmp(key, "block-bits") == 0 && fscanf(prof_fp, "%d", &bits) == 1)
+            continue;
+        if (strcmp(key, "ops") == 0 &&
+            fscanf(prof_fp, "%lld %lld %lld", &v1, &v2, &v3) == 3) {
+            ops[0] = v1, ops[1] = v2, ops[2] = v3;
+        } else if (strcmp(key, "len") == 0 &&
+                   fscanf(prof_fp, "%lld %lld", &v1, &v2) == 2) {
+            if (v1 >= 0 && v1 <= 16)
+                lens[v1] = v2;
+        } else if (strcmp(key, "cold") == 0 &&
+                   fscanf(prof_fp, "%lld", &v1) == 1) {
+            reuse[LIFE_BUCKETS] = v1;
+        } else if (strcmp(key, "reuse") == 0 &&
+                   fscanf(prof_fp, "%lld %lld", &v1, &v2) == 2) {
+            if (v1 >= 0 && v1 < LIFE_BUCKETS)
+                reuse[v1] = v2;
+        } else if (strcmp(key, "cold-class") == 0 &&
+                   fscanf(prof_fp, "%lld %lld %lld", &v1, &v2, &v3) == 3) {
+            cls[0] = v1, cls[1] = v2, cls[2] = v3;
+        } else if (strcmp(key, "stride") == 0 &&
+                   fscanf(prof_fp, "%lld %lld", &v1, &v2) == 2) {
+            if (nstride < MAX_STRIDES) {
+                stride_val[nstride] = v1;
+                stride_cnt[nstride++] = v2;
+            }
+        } else {
+            // unknown or malformed line: skip the rest of it
+            fscanf(prof_fp, "%*[^\n]");
+        }
+    }
+    fclose(prof_fp);
+
+    unsigned long long state = seed;
+    lru_stack_t st;
+    mem_addr_t cold = mix64(&state) & 0xffffff;
+    long long cold_delta = 1;
+    memset(&st, 0, sizeof(st));
+
+    for (long long i = 0; i < gen_length; i++) {
+        int op = sampleWeighted(ops, 3, &state);
+        int len = sampleWeighted(lens, 17, &state);
+        int k = sampleWeighted(reuse, LIFE_BUCKETS + 1, &state);
+        mem_addr_t block;
+
+        // a distance uniform within the bucket, if that deep a stack exists
+        long long dist = k <= 0 ? 0 :
+            (1LL << (k - 1)) + mix64(&state) % (1LL << (k - 1));
+        if (k >= 0 && k < LIFE_BUCKETS && dist < st.distinct) {
+            block = stackBlockAt(&st, dist);
+        } else {
+            // new data, laid out like the program's
+            switch (sampleWeighted(cls, CLASSES, &state)) {
+                case CLASS_SEQUENTIAL:
+                    cold_delta = 1;
+                    break;
+                case CLASS_STRIDED: {
+                    int j = sampleWeighted(stride_cnt, nstride, &state);
+                    if (j >= 0)
+                        cold_delta = stride_val[j];
+                    break;
+                }
+                default:
+                    cold_delta = (mix64(&state) & 0xfffff) + 2;
+                    break;
+            }
+            cold += cold_delta;
+            block = cold;
+        }
+        stackAccess(&st, block);
+        printf(" %c %llx,%d\n", "LSM"[op < 0 ? 0 : op], block << bits,
+               len < 0 ? 8 : len);
+    }
+    stackFree(&st);
+}
+
+/*
+ * benchOne - Simulate n records on a fresh cache of the current geometry
+ *   and return the elapsed seconds. Only the replay loop is timed.
+ */
+double benchOne(trace_rec_t* recs, long long n) {
+    struct timespec t0, t1;
+
+    hit_cnt = miss_cnt = evict_cnt = 0;
+    initCache();
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (long long i = 0; i < n; i++)
+        replayRecord(recs[i].op, recs[i].addr, recs[i].len);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    freeCache();
+    return (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+}
+
+/*
+ * hostFingerprint - Identify the benchmark host by its name, machine
+ *   type, CPU model and CPU count, so baselines from different hosts are
+ *   never compared.
+ */
+unsigned long long hostFingerprint() {
+    char line[256];
+    struct utsname host;
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned long long h = HASH_INIT;
+    FILE* cpu_fp = fopen("/proc/cpuinfo", "r");
+
+    uname(&host);
+    h = hashBytes(h, host.nodename, strlen(host.nodename));
+    h = hashBytes(h, host.machine, strlen(host.machine));
+    h = hashBytes(h, &ncpu, sizeof(ncpu));
+    if (cpu_fp) {
+        while (fgets(line, sizeof(line), cpu_fp) != NULL) {
+            if (strncmp(line, "model name", 10) == 0) {
+                h = hashBytes(h, line, strlen(line));
+                break;
+            }
+        }
+        fclose(cpu_fp);
+    }
+    return h;
+}
+
+/*
+ * compareDouble - qsort comparator for doubles.
+ */
+int compareDouble(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * medianCI - Sort the n rates and return their median, with a roughly 95%
+ *   distribution-free confidence interval for it from the order statistics
+ *   at n/2 -+ 0.98*sqrt(n). With few repetitions the interval is simply
+ *   the full range.
+ */
+double medianCI(double* rates, int n, double* lo, double* hi) {
+    qsort(rates, n, sizeof(double), compareDouble);
+    int k = (int)floor(n / 2.0 - 0.98 * sqrt(n));
+    int j = (int)ceil(n / 2.0 + 0.98 * sqrt(n)) - 1;
+    *lo = rates[k < 0 ? 0 : k];
+    *hi = rates[j >= n ? n - 1 : j];
+    return n % 2 ? rates[n / 2] : (rates[n / 2 - 1] + rates[n / 2]) / 2;
+}
+
+/*
+ * Type: Benchmark baseline entry
+ * The baseline file holds one line per host and benchmark:
+ * "<host> <bench> <s> <E> <b> <policy> <median accesses/s>".
+ */
+typedef struct bench_base {
+    char line[128];       /* everything before the median */
+    double rate;
+} bench_base_t;
+
+/*
+ * loadBaseline - Read the --bench-baseline file into a growable array.
+ */
+bench_base_t* loadBaseline(int* n) {
+    char line[256];
+    int cap = 64;
+    bench_base_t* base = malloc(cap * sizeof(bench_base_t));
+    FILE* base_fp = fopen(bench_baseline, "r");
+
+    *n = 0;
+    if (!base) {
+        printf("Cannot malloc benchmark baseline.");
+        exit(1);
+    }
+    if (!base_fp)
+        return base;
+    while (fgets(line, sizeof(line), base_fp) != NULL) {
+        char* sp = strrchr(line, ' ');
+        if (!sp || sp - line >= (int)sizeof(base->line))
+            continue;
+        if (*n == cap) {
+            cap *= 2;
+            base = realloc(base, cap * sizeof(bench_base_t));
+            if (!base) {
+                printf("Cannot malloc benchmark baseline.");
+                exit(1);
+            }
+        }
+        *sp = '\0';
+        strcpy(base[*n].line, line);
+        base[*n].rate = atof(sp + 1);
+        (*n)++;
+    }
+    fclose(base_fp);
+    return base;
+}
+
+/*
+ * saveBaseline - Rewrite the --bench-baseline file atomically.
+ */
+void saveBaseline(bench_base_t* base, int n) {
+    char tmp_fn[PATH_MAX];
+
+    snprintf(tmp_fn, sizeof(tmp_fn), "%s.tmp", bench_baseline);
+    FILE* base_fp = fopen(tmp_fn, "w");
+    if (!base_fp) {
+        fprintf(stderr, "%s: %s\n", tmp_fn, strerror(errno));
+        exit(1);
+    }
+    for (int i = 0; i < n; i++)
+        fprintf(base_fp, "%s %.0f\n", base[i].line, base[i].rate);
+    if (fclose(base_fp) != 0 || rename(tmp_fn, bench_baseline) != 0) {
+        fprintf(stderr, "%s: %s\n", bench_baseline, strerror(errno));
+        exit(1);
+    }
+}
+
+/*
+ * runBenchmarks - Time the simulation kernel on every synthetic pattern
+ *   for each geometry: the one given with -s/-E/-b, or a default set from
+ *   L1-like to LLC-like. Each benchmark runs --bench-reps times and reports
+ *   the median accesses per second with its confidence interval. With
+ *   --bench-out, one JSON object per benchmark is appended for tracking
+ *   over time. With --bench-baseline, the median is compared against this
+ *   host's stored baseline and a drop beyond --bench-threshold percent,
+ *   with the whole interval below the baseline, is flagged as a
+ *   regression. Returns the number of regressions.
+ */
+int runBenchmarks() {
+    static const int geoms[][3] = { {5, 1, 5}, {6, 8, 6}, {10, 8, 6},
+                                    {12, 16, 6} };
+    int ngeoms = sizeof(geoms) / sizeof(geoms[0]);
+    int given[3] = { s, E, b };
+    long long n = bench_accesses;
+    trace_rec_t* recs = malloc(n * sizeof(trace_rec_t));
+    double* rates = malloc(bench_reps * sizeof(double));
+    FILE* out_fp = NULL;
+    struct utsname host;
+    bench_base_t* base = NULL;
+    int nbase = 0;
+    int regressions = 0;
+
+    if (!recs || !rates) {
+        printf("Cannot malloc benchmark trace.");
+        exit(1);
+    }
+    if (bench_out) {
+        out_fp = fopen(bench_out, "a");
+        if (!out_fp) {
+            fprintf(stderr, "%s: %s\n", bench_out, strerror(errno));
+            exit(1);
+        }
+    }
+    if (bench_baseline)
+        base = loadBaseline(&nbase);
+    uname(&host);
+    unsigned long long fp = hostFingerprint();
+    verbosity = 0;
+
+    for (int kind = 0; kind < GEN_KINDS; kind++) {
+        genTrace(kind, n, recs);
+        for (int g = 0; g < (s ? 1 : ngeoms); g++) {
+            const int* geom = s ? given : geoms[g];
+            double lo, hi;
+            long long accesses = 0;
+            s = geom[0];
+            E = geom[1];
+            b = geom[2];
+
+            for (int r = 0; r < bench_reps; r++) {
+                double sec = benchOne(recs, n);
+                accesses = (long long)(hit_cnt + miss_cnt);
+                rates[r] = sec > 0 ? accesses / sec : 0;
+            }
+            double rate = medianCI(rates, bench_reps, &lo, &hi);
+            printf("bench: %-9s s=%-2d E=%-2d b=%-2d %-4s %8.2f M accesses/s"
+                   " [%.2f, %.2f]  miss rate %5.1f%%", gen_names[kind], s, E,
+                   b, policy_name, rate / 1e6, lo / 1e6, hi / 1e6,
+                   100.0 * miss_cnt / accesses);
+
+            // find this host's baseline for the benchmark
+            char key[128];
+            int i;
+            snprintf(key, sizeof(key), "%016llx %s %d %d %d %s", fp,
+                     gen_names[kind], s, E, b, policy_name);
+            for (i = 0; i < nbase; i++) {
+                if (strcmp(base[i].line, key) == 0)
+                    break;
+            }
+            if (i < nbase) {
+                double change = 100 * (rate - base[i].rate) / base[i].rate;
+                int regressed = change < -bench_threshold &&
+                                hi < base[i].rate;
+                printf("  baseline %.2f (%+.1f%%)%s", base[i].rate / 1e6,
+                       change, regressed ? "  REGRESSION" : "");
+                regressions += regressed;
+            }
+            printf("\n");
+
+            if (bench_save_baseline) {
+                if (i == nbase) {
+                    base = realloc(base, (nbase + 1) * sizeof(bench_base_t));
+                    if (!base) {
+                        printf("Cannot malloc benchmark baseline.");
+                        exit(1);
+                    }
+                    strcpy(base[nbase++].line, key);
+                }
+                base[i].rate = rate;
+            }
+
+            if (out_fp)
+                fprintf(out_fp, "{\"time\":%lld,\"host\":\"%s\","
+                        "\"machine\":\"%s\",\"host_id\":\"%016llx\","
+                        "\"bench\":\"%s\",\"s\":%d,\"E\":%d,\"b\":%d,"
+                        "\"policy\":\"%s\",\"accesses\":%lld,"
+                        "\"reps\":%d,\"accesses_per_sec\":%.0f,"
+                        "\"ci_low\":%.0f,\"ci_high\":%.0f,\"hits\":%llu,"
+                        "\"misses\":%llu,\"evictions\":%llu}\n",
+                        (long long)time(NULL), host.nodename, host.machine,
+                        fp, gen_names[kind], s, E, b, policy_name, accesses,
+                        bench_reps,
+                        rate, lo, hi, hit_cnt, miss_cnt, evict_cnt);
+            s = given[0];
+        }
+    }
+
+    if (bench_save_baseline)
+        saveBaseline(base, nbase);
+    if (regressions)
+        printf("bench: %d regression(s) beyond %.1f%%\n", regressions,
+               bench_threshold);
+
+    if (out_fp)
+        fclose(out_fp);
+    free(base);
+    free(rates);
+    free(recs);
+    return regressions;
+}
+
+/*
+ * diffCount - Charge an access of run side, and a miss, to c.
+ */
+static inline void diffCount(diff_cnt_t* c, int side, int miss) {
+    c->accesses[side]++;
+    c->misses[side] += miss;
+}
+
+/*
+ * diffRegion - Find (or claim) the counters of the region holding addr.
+ *   A full table folds new regions into diff_other.
+ */
+diff_cnt_t* diffRegion(mem_addr_t addr) {
+    mem_addr_t key = (addr >> region_bits) + 1;
+    unsigned int i = hash64(key) & (REGION_SLOTS - 1);
+
+    for (int probe = 0; probe < REGION_SLOTS; probe++) {
+        if (diff_regions[i].region == key)
+            return &diff_regions[i].cnt;
+        if (diff_regions[i].region == 0) {
+            diff_regions[i].region = key;
+            return &diff_regions[i].cnt;
+        }
+        i = (i + 1) & (REGION_SLOTS - 1);
+    }
+    return &diff_other;
+}
+
+/*
+ * diffStep - Read the next record of run and simulate it on the run's own
+ *   cache. Returns 0 at the end of its trace or --limit window. Each run
+ *   holds one READ_BATCH of decoded records at a time.
+ */
+int diffStep(diff_run_t* run, int side) {
+    access_rec_t* r;
+    long long start = skip_to < 0 ? 0 : skip_to;
+    long long ilen = interval_len > 0 ? interval_len : DIFF_INTERVAL;
+
+    // the window counts every record; the filters apply within it
+    do {
+        if (rec_limit >= 0 && run->recs >= start + rec_limit)
+            return 0;
+        if (run->pos == run->n) {
+            run->n = run->rd.decode(&run->rd, run->buf, READ_BATCH);
+            run->pos = 0;
+            if (run->n == 0)
+                return 0;
+        }
+        r = &run->buf[run->pos++];
+    } while (run->recs++ < start ||
+             (filtering && !keepRecord(r->op, r->addr, r->len)));
+    mem_addr_t address = r->addr;
+
+    long long iv = (run->recs - 1 - start) / ilen;
+    if (iv >= n_diff_intervals) {
+        long long n = n_diff_intervals ? 2 * n_diff_intervals : 64;
+        diff_intervals = realloc(diff_intervals, n * sizeof(diff_cnt_t));
+        if (!diff_intervals) {
+            printf("Cannot malloc diff intervals.");
+            exit(1);
+        }
+        memset(diff_intervals + n_diff_intervals, 0,
+               (n - n_diff_intervals) * sizeof(diff_cnt_t));
+        n_diff_intervals = n;
+    }
+
+    cache = run->cache;
+    cache_epoch = run->epoch;
+    hit_cnt = run->hits;
+    miss_cnt = run->misses;
+    evict_cnt = run->evicts;
+    if (r->op == 'F' || r->op == 'W' || r->op == 'G') {
+        flushData(r->op, address);
+        run->epoch = cache_epoch;
+        return 1;
+    }
+    for (int n = r->op == 'M' ? 2 : 1; n > 0; n--) {
+        if (r->op == 'X' || r->op == 'N')
+            accessBypass(address, r->op == 'N');
+        else
+            accessData(address);
+        int miss = (last_access.result & ACCESS_MISS) != 0;
+        diffCount(&diff_sets[last_access.set], side, miss);
+        diffCount(diffRegion(address), side, miss);
+        diffCount(&diff_intervals[iv], side, miss);
+    }
+    run->hits = hit_cnt;
+    run->misses = miss_cnt;
+    run->evicts = evict_cnt;
+    return 1;
+}
+
+/*
+ * diffImpact - How much c changed between the runs: the change in misses,
+ *   which is what costs time, whatever the access counts did.
+ */
+long long diffImpact(const diff_cnt_t* c) {
+    return llabs(c->misses[1] - c->misses[0]);
+}
+
+/*
+ * compareDiffRegions/compareDiffSets/compareDiffIntervals - qsort
+ *   comparators: the largest change first.
+ */
+int compareDiffRegions(const void* a, const void* b) {
+    long long x = diffImpact(&((const diff_region_t*)a)->cnt);
+    long long y = diffImpact(&((const diff_region_t*)b)->cnt);
+    return (y > x) - (y < x);
+}
+
+int compareDiffSets(const void* a, const void* b) {
+    long long x = diffImpact(&diff_sets[*(const int*)a]);
+    long long y = diffImpact(&diff_sets[*(const int*)b]);
+    return (y > x) - (y < x);
+}
+
+int compareDiffIntervals(const void* a, const void* b) {
+    long long x = diffImpact(&diff_intervals[*(const long long*)a]);
+    long long y = diffImpact(&diff_intervals[*(const long long*)b]);
+    return (y > x) - (y < x);
+}
+
+/*
+ * printDiff - Print one "A -> B" line of the diff report.
+ */
+void printDiff(char* label, diff_cnt_t* c) {
+    double ra = c->accesses[0] ? 100.0 * c->misses[0] / c->accesses[0] : 0;
+    double rb = c->accesses[1] ? 100.0 * c->misses[1] / c->accesses[1] : 0;
+
+    printf("diff: %-32s misses:%lld -> %lld (%+lld) miss-rate:%.2f%% -> "
+           "%.2f%%\n", label, c->misses[0], c->misses[1],
+           c->misses[1] - c->misses[0], ra, rb);
+}
+
+/*
+ * diffTraces - Replay the -t trace (A) and the --diff trace (B) in
+ *   lockstep on two caches of the same geometry, each read in
+ *   --trace-format and through the --ops and --addr-range filters, then
+ *   report both totals and the sets, regions and intervals whose misses
+ *   changed most.
+ */
+void diffTraces() {
+    diff_run_t runs[2];
+    char label[96];
+    int live = 2;
+
+    memset(runs, 0, sizeof(runs));
+    runs[0].trace_fn = trace_file;
+    runs[1].trace_fn = diff_file;
+    for (int i = 0; i < 2; i++) {
+        openReader(&runs[i].rd, runs[i].trace_fn);
+        runs[i].buf = malloc(READ_BATCH * sizeof(access_rec_t));
+        if (!runs[i].buf) {
+            printf("Cannot malloc diff buffer.");
+            exit(1);
+        }
+        initCache();
+        runs[i].cache = cache;
+    }
+    diff_sets = calloc(S, sizeof(diff_cnt_t));
+    if (!diff_sets) {
+        printf("Cannot malloc diff sets.");
+        exit(1);
+    }
+
+    // alternate records while both runs last, then finish the longer one
+    while (live == 2) {
+        live = diffStep(&runs[0], 0);
+        live += diffStep(&runs[1], 1);
+    }
+    while (diffStep(&runs[0], 0))
+        ;
+    while (diffStep(&runs[1], 1))
+        ;
+
+    diff_cnt_t total;
+    memset(&total, 0, sizeof(total));
+    for (int i = 0; i < 2; i++) {
+        fclose(runs[i].rd.fp);
+        free(runs[i].buf);
+        total.accesses[i] = (long long)(runs[i].hits + runs[i].misses);
+        total.misses[i] = runs[i].misses;
+        printf("diff: %s %s hits:%llu misses:%llu evictions:%llu\n", i ? "B" : "A",
+               runs[i].trace_fn, runs[i].hits, runs[i].misses,
+               runs[i].evicts);
+    }
+    printDiff("total", &total);
+
+    int* set_order = malloc(S * sizeof(int));
+    long long* iv_order = malloc(n_diff_intervals * sizeof(long long));
+    if (!set_order || !iv_order) {
+        printf("Cannot malloc diff report.");
+        exit(1);
+    }
+    for (int i = 0; i < S; i++)
+        set_order[i] = i;
+    qsort(set_order, S, sizeof(int), compareDiffSets);
+    for (int i = 0; i < S && i < 10 && diffImpact(&diff_sets[set_order[i]]);
+         i++) {
+        snprintf(label, sizeof(label), "set %d", set_order[i]);
+        printDiff(label, &diff_sets[set_order[i]]);
+    }
+
+    qsort(diff_regions, REGION_SLOTS, sizeof(diff_region_t),
+          compareDiffRegions);
+    for (int i = 0; i < 10 && diffImpact(&diff_regions[i].cnt); i++) {
+        snprintf(label, sizeof(label), "region %#llx",
+                 (diff_regions[i].region - 1) << region_bits);
+        printDiff(label, &diff_regions[i].cnt);
+    }
+    if (diffImpact(&diff_other))
+        printDiff("other regions", &diff_other);
+
+    long long ilen = interval_len > 0 ? interval_len : DIFF_INTERVAL;
+    for (long long i = 0; i < n_diff_intervals; i++)
+        iv_order[i] = i;
+    qsort(iv_order, n_diff_intervals, sizeof(long long),
+          compareDiffIntervals);
+    for (int i = 0; i < n_diff_intervals && i < 10 &&
+         diffImpact(&diff_intervals[iv_order[i]]); i++) {
+        snprintf(label, sizeof(label), "interval %lld (records %lld-%lld)",
+                 iv_order[i] + 1, iv_order[i] * ilen,
+                 (iv_order[i] + 1) * ilen - 1);
+        printDiff(label, &diff_intervals[iv_order[i]]);
+    }
+
+    free(iv_order);
+    free(set_order);
+    free(diff_intervals);
+    free(diff_sets);
+    for (int i = 0; i < 2; i++) {
+        cache = runs[i].cache;
+        freeCache();
+    }
+}
+
+/* Type: A field of a stats file, named "<section>.<key>": a number, or
+ * for string fields their text */
+typedef struct stat_value {
+    char name[96];
+    double value;
+    int is_string;
+    char text[64];
+} stat_value_t;
+
+/*
+ * loadStats - Read the numeric fields of a --stats-out file, JSON or CSV,
+ *   into fields (at most max). Returns the number read, or -1 if the file
+ *   does not start with a csim-stats schema header.
+ */
+int loadStats(char* stats_fn, stat_value_t* fields, int max) {
+    char line[4096], section[48] = "", key[48], val[256], *end;
+    int n = 0;
+    FILE* stats_fp = fopen(stats_fn, "r");
+
+    if (!stats_fp) {
+        fprintf(stderr, "%s: %s\n", stats_fn, strerror(errno));
+        exit(1);
+    }
+    if (!fgets(line, sizeof(line), stats_fp)) {
+        fclose(stats_fp);
+        return -1;
+    }
+
+    if (strcmp(line, "{\n") == 0) {
+        // JSON as writeStats lays it out: one field per line
+        if (!fgets(line, sizeof(line), stats_fp) ||
+            strncmp(line, "  \"schema\": \"csim-stats/", 24) != 0) {
+            fclose(stats_fp);
+            return -1;
+        }
+        while (fgets(line, sizeof(line), stats_fp) && n < max) {
+            if (sscanf(line, " \"%47[^\"]\": %255[^,\n]", key, val) != 2)
+                continue;
+            if (val[0] == '{') {
+                snprintf(section, sizeof(section), "%s", key);
+                continue;
+            }
+            double v = strtod(val, &end);
+            snprintf(fields[n].name, sizeof(fields[n].name), "%s.%s",
+                     section, key);
+            fields[n].is_string = end == val;
+            fields[n].value = v;
+            // strings lose their quotes; null reads as the empty CSV cell
+            val[strcspn(val + 1, "\"") + 1] = '\0';
+            if (strcmp(val, "null") == 0)
+                val[0] = '\0';
+            snprintf(fields[n++].text, sizeof(fields[0].text), "%.63s",
+                     val[0] == '"' ? val + 1 : val);
+        }
+    } else if (strncmp(line, "schema,", 7) == 0) {
+        // CSV: a header of <section>_<key> names and one row of values
+        char names[4096], *name = names, *p;
+        snprintf(names, sizeof(names), "%s", line);
+        if (!fgets(line, sizeof(line), stats_fp)) {
+            fclose(stats_fp);
+            return -1;
+        }
+        p = line;
+        while (name && *p && n < max) {
+            char* next = strchr(name, ',');
+            if (next)
+                *next++ = '\0';
+            name[strcspn(name, "\n")] = '\0';
+            // the first '_' ends the section name
+            char* us = strchr(name, '_');
+            if (us)
+                *us = '.';
+            snprintf(fields[n].name, sizeof(fields[n].name), "%.95s", name);
+            fields[n].value = 0;
+            fields[n].is_string = 1;
+            size_t k = 0;
+            if (*p == '"') {
+                // quoted string: "" is an escaped quote
+                for (p++; *p && !(p[0] == '"' && p[1] != '"'); p++) {
+                    if (p[0] == '"')
+                        p++;
+                    if (k < sizeof(fields[n].text) - 1)
+                        fields[n].text[k++] = *p;
+                }
+                if (*p)
+                    p++;
+            } else {
+                double v = strtod(p, &end);
+                if (end != p) {
+                    fields[n].value = v;
+                    fields[n].is_string = 0;
+                    p = end;
+                }
+            }
+            fields[n].text[k] = '\0';
+            if (us)
+                n++;
+            p += strcspn(p, ",\n");
+            if (*p == ',')
+                p++;
+            name = next;
+        }
+    } else {
+        n = -1;
+    }
+    fclose(stats_fp);
+    return n;
+}
+
+/*
+ * compareFieldChange - qsort comparator on pairs of fields (A, B): the
+ *   largest relative change first.
+ */
+int compareFieldChange(const void* a, const void* b) {
+    const stat_value_t* x = a;
+    const stat_value_t* y = b;
+    double cx = fabs(x[1].value - x[0].value) /
+                (fabs(x[0].value) > 0 ? fabs(x[0].value) : 1);
+    double cy = fabs(y[1].value - y[0].value) /
+                (fabs(y[0].value) > 0 ? fabs(y[0].value) : 1);
+    return (cy > cx) - (cy < cx);
+}
+
+/*
+ * diffStats - Compare two --stats-out files field by field and print the
+ *   changed counters, rates and analysis results, largest relative change
+ *   first. Geometry differences are reported, not refused. Returns 0, or
+ *   -1 if neither file is a stats file.
+ */
+int diffStats(char* a_fn, char* b_fn) {
+    stat_value_t a[256], b[256], pairs[512];
+    int na = loadStats(a_fn, a, 256);
+    int nb = loadStats(b_fn, b, 256);
+    int n = 0;
+
+    if (na < 0 && nb < 0)
+        return -1;
+    // a stats file and anything else cannot be compared
+    if (na < 0 || nb < 0) {
+        fprintf(stderr, "%s: not a csim stats file\n", na < 0 ? a_fn : b_fn);
+        exit(1);
+    }
+    for (int i = 0; i < na; i++) {
+        for (int j = 0; j < nb; j++) {
+            if (strcmp(a[i].name, b[j].name) != 0)
+                continue;
+            if (strncmp(a[i].name, "config.", 7) == 0) {
+                // the runs are expected to differ in their trace
+                if (a[i].is_string && strcmp(a[i].name, "config.trace") &&
+                    strcmp(a[i].text, b[j].text))
+                    printf("diff: warning: %s differs (%s vs %s)\n",
+                           a[i].name, a[i].text, b[j].text);
+                else if (a[i].value != b[j].value)
+                    printf("diff: warning: %s differs (%g vs %g)\n",
+                           a[i].name, a[i].value, b[j].value);
+            } else if (strncmp(a[i].name, "host.", 5) != 0 &&
+                       !a[i].is_string && a[i].value != b[j].value) {
+                pairs[n++] = a[i];
+                pairs[n++] = b[j];
+            }
+            break;
+        }
+    }
+    qsort(pairs, n / 2, 2 * sizeof(stat_value_t), compareFieldChange);
+    for (int i = 0; i < n; i += 2) {
+        double d = pairs[i + 1].value - pairs[i].value;
+        printf("diff: %-28s %g -> %g (%+g", pairs[i].name, pairs[i].value,
+               pairs[i + 1].value, d);
+        if (pairs[i].value != 0)
+            printf(", %+.1f%%", 100.0 * d / fabs(pairs[i].value));
+        printf(")\n");
+    }
+    if (n == 0)
+        printf("diff: no differences\n");
+    return 0;
+}
+
+/* Type: Counters of one --cat-sweep layout, sent back by its child */
+typedef struct layout_result {
+    long long hits[MAX_TENANTS + 1];   /* last: other_tenant */
+    long long misses[MAX_TENANTS + 1];
+} layout_result_t;
+
+int* layouts = NULL;          /* ways per tenant, n_tenants per layout */
+layout_result_t* layout_results = NULL;
+
+/*
+ * addLayouts - Append every split of ways ways among tenants first..
+ *   n_tenants-1 (at least one each) to layouts, with widths[] holding the
+ *   ways of the tenants before first. Returns the new layout count.
+ */
+int addLayouts(int* widths, int first, int ways, int n) {
+    if (first == n_tenants - 1) {
+        widths[first] = ways;
+        memcpy(layouts + (size_t)n * n_tenants, widths,
+               n_tenants * sizeof(int));
+        return n + 1;
+    }
+    for (int w = 1; w <= ways - (n_tenants - 1 - first); w++) {
+        widths[first] = w;
+        n = addLayouts(widths, first + 1, ways - w, n);
+    }
+    return n;
+}
+
+/*
+ * compareLayouts - qsort comparator on layout numbers: most hits first.
+ */
+int compareLayouts(const void* a, const void* b) {
+    long long x = 0, y = 0;
+
+    for (int i = 0; i <= MAX_TENANTS; i++) {
+        x += layout_results[*(const int*)a].hits[i];
+        y += layout_results[*(const int*)b].hits[i];
+    }
+    return (y > x) - (y < x);
+}
+
+/*
+ * catSweep - Replay the trace under every layout of contiguous,
+ *   non-overlapping way masks for the --cat tenants, in that order from
+ *   way 0, and print the layouts from most to fewest hits with each
+ *   tenant's hit rate. Each layout runs in a child process, as many at a
+ *   time as there are CPUs; a child reports its counters through a pipe.
+ */
+void catSweep() {
+    int widths[MAX_TENANTS];
+    long long count = 1;
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+
+    // C(E-1, n_tenants-1) layouts
+    for (int i = 1; i < n_tenants; i++)
+        count = count * (E - i) / i;
+    if (count < 1 || count > 100000) {
+        printf("cat-sweep: %lld layouts of %d ways for %d tenants\n", count,
+               E, n_tenants);
+        exit(1);
+    }
+    layouts = malloc(count * n_tenants * sizeof(int));
+    layout_results = calloc(count, sizeof(layout_result_t));
+    int* order = malloc(count * sizeof(int));
+    pid_t* pids = malloc(count * sizeof(pid_t));
+    int* fds = malloc(count * sizeof(int));
+    if (!layouts || !layout_results || !order || !pids || !fds) {
+        printf("Cannot malloc cat sweep.");
+        exit(1);
+    }
+    addLayouts(widths, 0, E, 0);
+
+    long long next = 0, running = 0, done = 0;
+    while (done < count) {
+        while (next < count && running < (ncpu > 0 ? ncpu : 1)) {
+            int fd[2];
+            int start = 0;
+            for (int i = 0; i < n_tenants; i++) {
+                int w = layouts[next * n_tenants + i];
+                tenants[i].mask = wayMask(w) << start;
+                start += w;
+            }
+            // a layout simulated before is read from --results-store
+            char key[2048];
+            int memoize = results_store && resultKey(key, sizeof(key));
+            if (memoize && lookupResult(key)) {
+                layout_result_t* res = &layout_results[next];
+                long long* counters[MAX_RESULT_COUNTERS];
+                for (int i = 0; i < n_tenants; i++) {
+                    res->hits[i] = tenants[i].hits;
+                    res->misses[i] = tenants[i].misses;
+                }
+                res->hits[MAX_TENANTS] = other_tenant.hits;
+                res->misses[MAX_TENANTS] = other_tenant.misses;
+                // the children that simulate other layouts start at 0
+                int n = resultCounters(counters);
+                for (int i = 0; i < n; i++)
+                    *counters[i] = 0;
+                hit_cnt = miss_cnt = evict_cnt = 0;
+                pids[next++] = 0;
+                done++;
+                continue;
+            }
+            if (pipe(fd) != 0) {
+                fprintf(stderr, "pipe: %s\n", strerror(errno));
+                exit(1);
+            }
+            fflush(stdout);
+            pids[next] = fork();
+            if (pids[next] < 0) {
+                fprintf(stderr, "fork: %s\n", strerror(errno));
+                exit(1);
+            }
+            if (pids[next] == 0) {
+                layout_result_t res;
+                close(fd[0]);
+                initCache();
+                replay(trace_file);
+                if (memoize)
+                    storeResult(key);
+                memset(&res, 0, sizeof(res));
+                for (int i = 0; i < n_tenants; i++) {
+                    res.hits[i] = tenants[i].hits;
+                    res.misses[i] = tenants[i].misses;
+                }
+                res.hits[MAX_TENANTS] = other_tenant.hits;
+                res.misses[MAX_TENANTS] = other_tenant.misses;
+                _exit(write(fd[1], &res, sizeof(res)) == sizeof(res) ? 0 : 1);
+            }
+            close(fd[1]);
+            fds[next++] = fd[0];
+            running++;
+        }
+
+        // the result is small enough to sit in the pipe until the child
+        // has exited
+        int status;
+        pid_t pid = wait(&status);
+        long long i;
+        for (i = 0; i < next && pids[i] != pid; i++)
+            ;
+        if (i == next)
+            continue;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 ||
+            read(fds[i], &layout_results[i], sizeof(layout_result_t))
+                != sizeof(layout_result_t)) {
+            fprintf(stderr, "cat-sweep: layout %lld failed\n", i);
+            exit(1);
+        }
+        close(fds[i]);
+        running--;
+        done++;
+    }
+
+    for (int i = 0; i < count; i++)
+        order[i] = i;
+    qsort(order, count, sizeof(int), compareLayouts);
+    for (int k = 0; k < count; k++) {
+        layout_result_t* res = &layout_results[order[k]];
+        long long hits = res->hits[MAX_TENANTS];
+        long long n = hits + res->misses[MAX_TENANTS];
+        int start = 0;
+
+        printf("cat-sweep:");
+        for (int i = 0; i < n_tenants; i++) {
+            int w = layouts[order[k] * n_tenants + i];
+            long long t = res->hits[i] + res->misses[i];
+            printf(" %#llx %.2f%%", wayMask(w) << start,
+                   t ? 100.0 * res->hits[i] / t : 0);
+            start += w;
+            hits += res->hits[i];
+            n += t;
+        }
+        printf("  hits:%lld hit-rate:%.2f%%\n", hits,
+               n ? 100.0 * hits / n : 0);
+    }
+
+    free(fds);
+    free(pids);
+    free(order);
+    free(layout_results);
+    free(layouts);
 }
 
 /*
  * printUsage - Print usage info
  */
 void printUsage(char* argv[]) {
-    printf("Usage: %s [-hv] -s <num> -E <num> -b <num> -t <file>\n", argv[0]);
+    printf("Usage: %s [-hv] -s <num> -E <num> -b <num> -t <file> "
+           "[options]\n", argv[0]);
     printf("Options:\n");
     printf("  -h         Print this help message.\n");
     printf("  -v         Optional verbose flag.\n");
@@ -247,31 +5022,298 @@ void printUsage(char* argv[]) {
     printf("  -E <num>   Number of lines per set.\n");
     printf("  -b <num>   Number of block offset bits.\n");
     printf("  -t <file>  Trace file.\n");
+    printf("  --save-state <file>  Save the cache state and trace position.\n");
+    printf("  --save-at <num>      Save the state after <num> records "
+           "(default: at the end).\n");
+    printf("  --restore <file>     Continue from a saved state.\n");
+    printf("  --skip-to <num>      Do not simulate records before <num>.\n");
+    printf("  --skip <num>         Same as --skip-to.\n");
+    printf("  --limit <num>        Simulate at most <num> records.\n");
+    printf("  --policy <name>      Replacement policy: lru (default); lip, "
+           "bip or dip, which\n"
+           "                       insert at LRU, mostly at LRU, or as "
+           "set dueling picks;\n"
+           "                       ship or hawkeye, which use the PC of "
+           "each access.\n");
+    printf("  --cat <mask>[:<sel>] Let the accesses of a tenant fill only "
+           "the ways in <mask>.\n"
+           "                       <sel> is t<thread>, s<source> or <lo>-<hi> "
+           "(hex); without\n"
+           "                       it, <mask> applies to all other "
+           "accesses. May be repeated.\n");
+    printf("  --cat-sweep          Replay every contiguous way layout of "
+           "the --cat tenants\n"
+           "                       in parallel and rank them by hits.\n");
+    printf("  --corun <file>       Replay <file> into the same cache as "
+           "-t, as source 1,\n"
+           "                       2, ... (-t is source 0). May be "
+           "repeated.\n");
+    printf("  --interleave <how>   Order of the co-run sources: rr[:<n>] "
+           "takes turns of n\n"
+           "                       records (default 1), rate:<r0>,<r1>,... "
+           "turns of r0, r1,\n"
+           "                       ... records, time follows drmemtrace "
+           "timestamps.\n");
+    printf("  --trace-format <fmt> Trace format: lackey (default), "
+           "drmemtrace, champsim\n"
+           "                       or raw (little-endian 64-bit "
+           "addresses).\n");
+    printf("  --ops <types>        Simulate only these record types, e.g. "
+           "S or LM.\n");
+    printf("  --addr-range <lo-hi> Simulate only accesses overlapping "
+           "[lo, hi) (hex;\n"
+           "                       may be repeated).\n");
+    printf("  --filter-out <file>  Write the records kept by the filters, "
+           "and every I line,\n"
+           "                       to <file>.\n");
+    printf("  --index              Seek with <file>.idx, building it if "
+           "needed.\n");
+    printf("  --trace-cache <dir>  Keep a decoded copy of the trace in "
+           "<dir>.\n");
+    printf("  --trace-cache-max <bytes>  Evict old copies beyond this size "
+           "(K/M/G suffix).\n");
+    printf("  --results-store <file>  Reuse results stored in <file> and "
+           "append new ones.\n");
+    printf("  --profile            Report time per stage, accesses/s and "
+           "peak memory.\n");
+    printf("  --perf-counters      Report host cycles, IPC and cache/TLB/"
+           "branch misses\n"
+           "                       of the whole replay (there is no "
+           "per-phase breakdown).\n");
+    printf("  --bench              Benchmark the simulator on synthetic "
+           "traces.\n");
+    printf("  --bench-accesses <num>  Records per benchmark run.\n");
+    printf("  --bench-out <file>   Append benchmark results to <file> as "
+           "JSON lines.\n");
+    printf("  --bench-reps <num>   Repetitions per benchmark (median is "
+           "reported).\n");
+    printf("  --bench-baseline <file>  Compare against this host's "
+           "baseline in <file>.\n");
+    printf("  --bench-save-baseline  Store this run as the baseline.\n");
+    printf("  --bench-threshold <pct>  Slowdown that counts as a "
+           "regression.\n");
+    printf("  --gen <kind>         Write a synthetic trace to stdout: seq, "
+           "stride,\n"
+           "                       random, zipf, chase or transpose.\n");
+    printf("  --gen-length <num>   Records to generate.\n");
+    printf("  --seed <num>         Seed for --gen, --gen-profile and "
+           "--bench.\n");
+    printf("  --reuse-profile <file>  Write the reuse-distance and stride "
+           "profile.\n");
+    printf("  --gen-profile <file> Write a synthetic trace matching a "
+           "profile to stdout.\n");
+    printf("  --diff <file>        Compare the -t trace with <file> in "
+           "lockstep and rank the\n"
+           "                       sets, regions and intervals whose "
+           "misses changed; given\n"
+           "                       two --stats-out files, compare their "
+           "fields.\n");
+    printf("  --event-log <file>   Write the outcome of every access to "
+           "<file>.\n");
+    printf("  --event-format <fmt> Event log format: text (default) or "
+           "bin.\n");
+    printf("  --stats-out <file>   Write configuration, counters, rates, "
+           "timing and host\n"
+           "                       info to <file> instead of .csim_results."
+           "\n");
+    printf("  --format <fmt>       --stats-out format: json (default) or "
+           "csv.\n");
+    printf("  --progress[=<sec>]   Report progress, speed, ETA and miss "
+           "rate every <sec>\n"
+           "                       seconds (default 10) to stderr.\n");
+    printf("  --dump-file <file>   Where SIGUSR1 writes a statistics "
+           "snapshot\n"
+           "                       (default csim.<pid>.dump).\n");
+    printf("  --interval <num>     Report interval statistics every <num> "
+           "records.\n");
+    printf("  --footprint          Estimate distinct blocks and pages "
+           "touched.\n");
+    printf("  --page-bits <num>    Page size for --footprint (default 12)."
+           "\n");
+    printf("  --lifetimes          Report line lifetimes and never-reused "
+           "fills per set\n"
+           "                       and per region, with hit, live and dead "
+           "time\n"
+           "                       histograms for each reported region.\n");
+    printf("  --classify           Classify streams as sequential, strided "
+           "or irregular\n"
+           "                       and count the misses of each.\n");
+    printf("  --region-bits <num>  Region size for per-region reports and "
+           "streams\n"
+           "                       (default 20).\n");
+    printf("  --checkpoint-every <num>  Save the state in the background "
+           "every <num> records.\n");
+    printf("  --resume <file>      Continue from <file> if it exists and "
+           "checkpoint to it.\n");
     printf("\nExamples:\n");
     printf("  linux>  %s -s 4 -E 1 -b 4 -t traces/yi.trace\n", argv[0]);
     printf("  linux>  %s -v -s 8 -E 2 -b 4 -t traces/yi.trace\n", argv[0]);
+    printf("  linux>  %s -s 8 -E 2 -b 4 -t big.trace --save-state warm.ckpt "
+           "--save-at 1000000\n", argv[0]);
+    printf("  linux>  %s -s 8 -E 2 -b 4 -t big.trace --restore warm.ckpt\n",
+           argv[0]);
     exit(0);
 }
 
 /*
  * printSummary - Summarize the cache simulation statistics.
  */
-void printSummary(int hits, int misses, int evictions) {
-    printf("hits:%d misses:%d evictions:%d\n", hits, misses, evictions);
+void printSummary(unsigned long long hits, unsigned long long misses,
+                  unsigned long long evictions) {
+    printf("hits:%llu misses:%llu evictions:%llu\n", hits, misses, evictions);
+
+    // --stats-out replaces the shared file, which parallel runs would race on
+    if (stats_out)
+        return;
     FILE* output_fp = fopen(".csim_results", "w");
     assert(output_fp);
-    fprintf(output_fp, "%d %d %d\n", hits, misses, evictions);
+    fprintf(output_fp, "%llu %llu %llu\n", hits, misses, evictions);
     fclose(output_fp);
 }
 
+/*
+ * elapsedSince - Seconds of monotonic time since *start.
+ */
+double elapsedSince(struct timespec* start) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/*
+ * parseSize - Parse a byte count with an optional K, M or G suffix.
+ */
+long long parseSize(char* str) {
+    char* end;
+    long long size = strtoll(str, &end, 10);
+
+    switch (*end) {
+        case 'G': case 'g':
+            size <<= 10;
+            /* fall through */
+        case 'M': case 'm':
+            size <<= 10;
+            /* fall through */
+        case 'K': case 'k':
+            size <<= 10;
+            break;
+    }
+    return size;
+}
+
 /*
  * main - Main routine
  */
 int main(int argc, char* argv[]) {
-    char c;
+    int c;
+
+    // long-only options return values past the range of short options
+    enum {
+        OPT_SAVE_STATE = 256,
+        OPT_SAVE_AT,
+        OPT_RESTORE,
+        OPT_SKIP_TO,
+        OPT_CHECKPOINT_EVERY,
+        OPT_RESUME,
+        OPT_LIMIT,
+        OPT_TRACE_FORMAT,
+        OPT_POLICY,
+        OPT_CAT,
+        OPT_CAT_SWEEP,
+        OPT_CORUN,
+        OPT_INTERLEAVE,
+        OPT_OPS,
+        OPT_ADDR_RANGE,
+        OPT_FILTER_OUT,
+        OPT_INDEX,
+        OPT_TRACE_CACHE,
+        OPT_TRACE_CACHE_MAX,
+        OPT_RESULTS_STORE,
+        OPT_PROFILE,
+        OPT_PERF_COUNTERS,
+        OPT_BENCH,
+        OPT_BENCH_ACCESSES,
+        OPT_BENCH_OUT,
+        OPT_BENCH_REPS,
+        OPT_BENCH_BASELINE,
+        OPT_BENCH_SAVE_BASELINE,
+        OPT_BENCH_THRESHOLD,
+        OPT_GEN,
+        OPT_GEN_LENGTH,
+        OPT_SEED,
+        OPT_EVENT_LOG,
+        OPT_EVENT_FORMAT,
+        OPT_STATS_OUT,
+        OPT_FORMAT,
+        OPT_PROGRESS,
+        OPT_DUMP_FILE,
+        OPT_INTERVAL,
+        OPT_FOOTPRINT,
+        OPT_PAGE_BITS,
+        OPT_LIFETIMES,
+        OPT_REGION_BITS,
+        OPT_CLASSIFY,
+        OPT_REUSE_PROFILE,
+        OPT_GEN_PROFILE,
+        OPT_DIFF,
+    };
+    static struct option long_options[] = {
+        {"save-state", required_argument, NULL, OPT_SAVE_STATE},
+        {"save-at",    required_argument, NULL, OPT_SAVE_AT},
+        {"restore",    required_argument, NULL, OPT_RESTORE},
+        {"skip-to",    required_argument, NULL, OPT_SKIP_TO},
+        {"checkpoint-every", required_argument, NULL, OPT_CHECKPOINT_EVERY},
+        {"resume",     required_argument, NULL, OPT_RESUME},
+        {"skip",       required_argument, NULL, OPT_SKIP_TO},
+        {"limit",      required_argument, NULL, OPT_LIMIT},
+        {"trace-format", required_argument, NULL, OPT_TRACE_FORMAT},
+        {"policy",     required_argument, NULL, OPT_POLICY},
+        {"cat",        required_argument, NULL, OPT_CAT},
+        {"cat-sweep",  no_argument,       NULL, OPT_CAT_SWEEP},
+        {"corun",      required_argument, NULL, OPT_CORUN},
+        {"interleave", required_argument, NULL, OPT_INTERLEAVE},
+        {"ops",        required_argument, NULL, OPT_OPS},
+        {"addr-range", required_argument, NULL, OPT_ADDR_RANGE},
+        {"filter-out", required_argument, NULL, OPT_FILTER_OUT},
+        {"index",      no_argument,       NULL, OPT_INDEX},
+        {"trace-cache", required_argument, NULL, OPT_TRACE_CACHE},
+        {"trace-cache-max", required_argument, NULL, OPT_TRACE_CACHE_MAX},
+        {"results-store", required_argument, NULL, OPT_RESULTS_STORE},
+        {"profile",    no_argument,       NULL, OPT_PROFILE},
+        {"perf-counters", no_argument,    NULL, OPT_PERF_COUNTERS},
+        {"bench",      no_argument,       NULL, OPT_BENCH},
+        {"bench-accesses", required_argument, NULL, OPT_BENCH_ACCESSES},
+        {"bench-out",  required_argument, NULL, OPT_BENCH_OUT},
+        {"bench-reps", required_argument, NULL, OPT_BENCH_REPS},
+        {"bench-baseline", required_argument, NULL, OPT_BENCH_BASELINE},
+        {"bench-save-baseline", no_argument, NULL, OPT_BENCH_SAVE_BASELINE},
+        {"bench-threshold", required_argument, NULL, OPT_BENCH_THRESHOLD},
+        {"gen",        required_argument, NULL, OPT_GEN},
+        {"gen-length", required_argument, NULL, OPT_GEN_LENGTH},
+        {"seed",       required_argument, NULL, OPT_SEED},
+        {"event-log",  required_argument, NULL, OPT_EVENT_LOG},
+        {"event-format", required_argument, NULL, OPT_EVENT_FORMAT},
+        {"stats-out",  required_argument, NULL, OPT_STATS_OUT},
+        {"format",     required_argument, NULL, OPT_FORMAT},
+        {"progress",   optional_argument, NULL, OPT_PROGRESS},
+        {"dump-file",  required_argument, NULL, OPT_DUMP_FILE},
+        {"interval",   required_argument, NULL, OPT_INTERVAL},
+        {"footprint",  no_argument,       NULL, OPT_FOOTPRINT},
+        {"page-bits",  required_argument, NULL, OPT_PAGE_BITS},
+        {"lifetimes",  no_argument,       NULL, OPT_LIFETIMES},
+        {"region-bits", required_argument, NULL, OPT_REGION_BITS},
+        {"classify",   no_argument,       NULL, OPT_CLASSIFY},
+        {"reuse-profile", required_argument, NULL, OPT_REUSE_PROFILE},
+        {"gen-profile", required_argument, NULL, OPT_GEN_PROFILE},
+        {"diff",       required_argument, NULL, OPT_DIFF},
+        {NULL, 0, NULL, 0}
+    };
 
-    // Parse the command line arguments: -h, -v, -s, -E, -b, -t
-    while ((c = getopt(argc, argv, "s:E:b:t:vh")) != -1) {
+    // Parse the command line arguments: -h, -v, -s, -E, -b, -t and the
+    // long options above
+    while ((c = getopt_long(argc, argv, "s:E:b:t:vh", long_options,
+                            NULL)) != -1) {
         switch (c) {
             case 'b':
                 b = atoi(optarg);
@@ -291,28 +5333,465 @@ int main(int argc, char* argv[]) {
             case 'v':
                 verbosity = 1;
                 break;
+            case OPT_SAVE_STATE:
+                save_state_file = optarg;
+                break;
+            case OPT_SAVE_AT:
+                save_at = atoll(optarg);
+                break;
+            case OPT_RESTORE:
+                restore_file = optarg;
+                break;
+            case OPT_SKIP_TO:
+                skip_to = atoll(optarg);
+                break;
+            case OPT_LIMIT:
+                rec_limit = atoll(optarg);
+                break;
+            case OPT_TRACE_FORMAT:
+                for (trace_format = 0; trace_format < FORMATS; trace_format++)
+                    if (strcmp(optarg, format_names[trace_format]) == 0)
+                        break;
+                if (trace_format == FORMATS) {
+                    printf("%s: Unknown trace format %s\n", argv[0], optarg);
+                    exit(1);
+                }
+                break;
+            case OPT_POLICY:
+                for (policy = 0; policy < POLICIES; policy++)
+                    if (strcmp(optarg, policy_names[policy]) == 0)
+                        break;
+                if (policy == POLICIES) {
+                    printf("%s: Unknown policy %s\n", argv[0], optarg);
+                    exit(1);
+                }
+                policy_name = policy_names[policy];
+                need_pc = policy == POLICY_SHIP || policy == POLICY_HAWKEYE;
+                break;
+            case OPT_CAT: {
+                char* end;
+                unsigned long long mask = strtoull(optarg, &end, 0);
+                partitioned = 1;
+                if (*end == '\0') {
+                    other_tenant.mask = mask;
+                    break;
+                }
+                if (*end != ':' || n_tenants == MAX_TENANTS) {
+                    printf("%s: Bad --cat %s (at most %d tenants)\n",
+                           argv[0], optarg, MAX_TENANTS);
+                    exit(1);
+                }
+                tenant_t* t = &tenants[n_tenants++];
+                memset(t, 0, sizeof(*t));
+                t->mask = mask;
+                t->thread = -1;
+                t->source = -1;
+                if (end[1] == 't') {
+                    t->thread = atoi(end + 2);
+                } else if (end[1] == 's') {
+                    t->source = atoi(end + 2);
+                } else {
+                    t->lo = strtoull(end + 1, &end, 16);
+                    if (*end != '-') {
+                        printf("%s: Bad --cat %s\n", argv[0], optarg);
+                        exit(1);
+                    }
+                    t->hi = strtoull(end + 1, NULL, 16);
+                }
+                break;
+            }
+            case OPT_CAT_SWEEP:
+                cat_sweep = 1;
+                break;
+            case OPT_CORUN:
+                if (n_sources == MAX_SOURCES) {
+                    printf("%s: At most %d trace sources\n", argv[0],
+                           MAX_SOURCES);
+                    exit(1);
+                }
+                source_files[n_sources++] = optarg;
+                break;
+            case OPT_INTERLEAVE: {
+                // rr[:Q], rate:R0,R1,... or time; sources without a rate
+                // take turns of one record
+                char* p = optarg + 4;
+                int ok = 1;
+                if (strcmp(optarg, "time") == 0) {
+                    interleave = INTERLEAVE_TIME;
+                } else if (strncmp(optarg, "rr", 2) == 0 &&
+                           (optarg[2] == '\0' || optarg[2] == ':')) {
+                    long long q = optarg[2] ? atoll(optarg + 3) : 1;
+                    for (int i = 0; i < MAX_SOURCES; i++)
+                        quanta[i] = q;
+                    ok = q > 0;
+                } else if (strncmp(optarg, "rate:", 5) == 0) {
+                    for (int i = 0; i < MAX_SOURCES && *p && ok; i++) {
+                        quanta[i] = strtoll(p + 1, &p, 10);
+                        ok = quanta[i] > 0 && (*p == ',' || *p == '\0');
+                    }
+                } else {
+                    ok = 0;
+                }
+                if (!ok) {
+                    printf("%s: Bad --interleave %s\n", argv[0], optarg);
+                    exit(1);
+                }
+                break;
+            }
+            case OPT_OPS:
+                filter_ops = optarg;
+                break;
+            case OPT_ADDR_RANGE: {
+                char* end;
+                if (n_ranges == MAX_RANGES) {
+                    printf("%s: At most %d --addr-range options\n", argv[0],
+                           MAX_RANGES);
+                    exit(1);
+                }
+                range_lo[n_ranges] = strtoull(optarg, &end, 16);
+                if (*end != '-') {
+                    printf("%s: Bad address range %s\n", argv[0], optarg);
+                    exit(1);
+                }
+                range_hi[n_ranges++] = strtoull(end + 1, NULL, 16);
+                break;
+            }
+            case OPT_FILTER_OUT:
+                filter_out = optarg;
+                break;
+            case OPT_INDEX:
+                use_index = 1;
+                break;
+            case OPT_TRACE_CACHE:
+                trace_cache_dir = optarg;
+                break;
+            case OPT_TRACE_CACHE_MAX:
+                trace_cache_max = parseSize(optarg);
+                break;
+            case OPT_RESULTS_STORE:
+                results_store = optarg;
+                break;
+            case OPT_PROFILE:
+                profiling = 1;
+                break;
+            case OPT_PERF_COUNTERS:
+                perf_counters = 1;
+                break;
+            case OPT_BENCH:
+                bench_mode = 1;
+                break;
+            case OPT_BENCH_ACCESSES:
+                bench_accesses = atoll(optarg);
+                break;
+            case OPT_BENCH_OUT:
+                bench_out = optarg;
+                break;
+            case OPT_BENCH_REPS:
+                bench_reps = atoi(optarg);
+                break;
+            case OPT_BENCH_BASELINE:
+                bench_baseline = optarg;
+                break;
+            case OPT_BENCH_SAVE_BASELINE:
+                bench_save_baseline = 1;
+                break;
+            case OPT_BENCH_THRESHOLD:
+                bench_threshold = atof(optarg);
+                break;
+            case OPT_GEN:
+                gen_kind = optarg;
+                break;
+            case OPT_GEN_LENGTH:
+                gen_length = atoll(optarg);
+                break;
+            case OPT_SEED:
+                seed = strtoull(optarg, NULL, 0);
+                break;
+            case OPT_EVENT_LOG:
+                event_log = optarg;
+                break;
+            case OPT_EVENT_FORMAT:
+                if (strcmp(optarg, "bin") == 0) {
+                    event_binary = 1;
+                } else if (strcmp(optarg, "text") != 0) {
+                    printf("%s: Unknown event format %s\n", argv[0], optarg);
+                    exit(1);
+                }
+                break;
+            case OPT_STATS_OUT:
+                stats_out = optarg;
+                break;
+            case OPT_FORMAT:
+                if (strcmp(optarg, "csv") == 0) {
+                    stats_csv = 1;
+                } else if (strcmp(optarg, "json") != 0) {
+                    printf("%s: Unknown stats format %s\n", argv[0], optarg);
+                    exit(1);
+                }
+                break;
+            case OPT_PROGRESS:
+                progress_secs = optarg ? atoi(optarg) : 10;
+                break;
+            case OPT_DUMP_FILE:
+                dump_file = optarg;
+                break;
+            case OPT_INTERVAL:
+                interval_len = atoll(optarg);
+                break;
+            case OPT_FOOTPRINT:
+                footprint = 1;
+                break;
+            case OPT_PAGE_BITS:
+                page_bits = atoi(optarg);
+                break;
+            case OPT_LIFETIMES:
+                lifetimes = 1;
+                break;
+            case OPT_REGION_BITS:
+                region_bits = atoi(optarg);
+                break;
+            case OPT_CLASSIFY:
+                classify = 1;
+                break;
+            case OPT_REUSE_PROFILE:
+                reuse_profile = optarg;
+                break;
+            case OPT_GEN_PROFILE:
+                gen_profile = optarg;
+                break;
+            case OPT_DIFF:
+                diff_file = optarg;
+                break;
+            case OPT_CHECKPOINT_EVERY:
+                checkpoint_every = atoll(optarg);
+                break;
+            case OPT_RESUME:
+                // the same command line starts a run and resumes it
+                save_state_file = optarg;
+                if (access(optarg, F_OK) == 0)
+                    restore_file = optarg;
+                if (checkpoint_every == 0)
+                    checkpoint_every = 1 << 24;
+                break;
             default:
                 printUsage(argv);
                 exit(1);
         }
     }
 
+    /* SIGUSR1 writes a snapshot of the counters to --dump-file */
+    // installed before any mode starts so that the signal never kills a
+    // run; modes without a replay loop just never act on it
+    char dump_fn[PATH_MAX];
+    if (!dump_file) {
+        snprintf(dump_fn, sizeof(dump_fn), "csim.%d.dump", (int)getpid());
+        dump_file = dump_fn;
+    }
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = onDumpSignal;
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &sa, NULL);
+
+    /* Modes that do not replay a trace file */
+    if (gen_profile) {
+        writeProfileTrace(gen_profile);
+        return 0;
+    }
+    if (gen_kind) {
+        int kind = genKind(gen_kind);
+        if (kind < 0) {
+            printf("%s: Unknown trace kind %s\n", argv[0], gen_kind);
+            exit(1);
+        }
+        writeGenTrace(kind);
+        return 0;
+    }
+    if (bench_mode) {
+        if ((s || E || b) && (s == 0 || E == 0 || b == 0)) {
+            printf("%s: --bench needs all or none of -s, -E and -b\n",
+                   argv[0]);
+            exit(1);
+        }
+        if (bench_reps < 1 || (bench_save_baseline && !bench_baseline)) {
+            printf("%s: --bench-reps must be positive and "
+                   "--bench-save-baseline needs --bench-baseline\n", argv[0]);
+            exit(1);
+        }
+        // a regression fails the run so the command can gate changes
+        return runBenchmarks() ? 2 : 0;
+    }
+
+    // two stats files need no geometry; two traces fall through
+    if (diff_file && trace_file && trace_format == FORMAT_LACKEY &&
+        diffStats(trace_file, diff_file) == 0)
+        return 0;
+
     /* Make sure that all required command line args were specified */
     if (s == 0 || E == 0 || b == 0 || trace_file == NULL) {
         printf("%s: Missing required command line argument\n", argv[0]);
         printUsage(argv);
         exit(1);
     }
+    if ((save_at >= 0 || checkpoint_every > 0) && save_state_file == NULL) {
+        printf("%s: --save-at and --checkpoint-every require --save-state\n",
+               argv[0]);
+        exit(1);
+    }
+    // checkpoints and --diff hold the cache lines but not the policy's
+    // global state
+    if (policy != POLICY_LRU && policy != POLICY_LIP &&
+        (save_state_file || restore_file || diff_file)) {
+        printf("%s: --save-state, --restore and --diff do not support "
+               "--policy %s\n", argv[0], policy_name);
+        exit(1);
+    }
+    // co-run sources are read from their start, and not into checkpoints
+    if (n_sources > 1 && (save_state_file || restore_file || skip_to >= 0 ||
+                          diff_file)) {
+        printf("%s: --corun does not support --save-state, --restore, "
+               "--resume, --skip-to or --diff\n", argv[0]);
+        exit(1);
+    }
+    if (interleave == INTERLEAVE_TIME && trace_format != FORMAT_DRMEMTRACE) {
+        printf("%s: --interleave time needs --trace-format drmemtrace\n",
+               argv[0]);
+        exit(1);
+    }
+    // a way mask has a bit for each of at most 64 ways
+    if (partitioned && E > 64) {
+        printf("%s: --cat supports at most 64 ways\n", argv[0]);
+        exit(1);
+    }
+    // a way mask must leave the tenant a way to fill (a sweep sets them)
+    unsigned long long all_ways = wayMask(E);
+    for (int i = cat_sweep ? n_tenants : 0; i <= n_tenants && partitioned;
+         i++) {
+        tenant_t* t = i < n_tenants ? &tenants[i] : &other_tenant;
+        if ((t->mask & all_ways) == 0) {
+            printf("%s: Way mask %#llx selects none of the %d ways\n",
+                   argv[0], t->mask, E);
+            exit(1);
+        }
+    }
+    if (cat_sweep) {
+        if (n_tenants < 1 || save_state_file || restore_file || diff_file) {
+            printf("%s: --cat-sweep needs --cat tenants with selectors and "
+                   "no checkpoints\n", argv[0]);
+            exit(1);
+        }
+        progress_secs = 0;
+        catSweep();
+        return 0;
+    }
+    if (diff_file) {
+        // both runs would share the tenants and the filtered output, and
+        // the analyses and reports are set up for a single run
+        if (partitioned || filter_out || verbosity || event_log ||
+            lifetimes || classify || footprint || reuse_profile ||
+            progress_secs || stats_out || profiling || perf_counters) {
+            printf("%s: --diff does not support --cat, --filter-out, -v, "
+                   "--event-log, --lifetimes,\n--classify, --footprint, "
+                   "--reuse-profile, --progress, --stats-out, --profile or "
+                   "--perf-counters\n", argv[0]);
+            exit(1);
+        }
+        filtering = filter_ops || n_ranges;
+        diffTraces();
+        return 0;
+    }
+
+    /* Start the profiling clocks */
+    clock_gettime(CLOCK_MONOTONIC, &run_start);
+    unsigned long long start_tick = profTick();
+    prof_last = start_tick;
+
+    /* Reuse the result of an identical earlier run */
+    char key[2048];
+    int memoize = results_store && resultKey(key, sizeof(key));
+    if (memoize && lookupResult(key)) {
+        // nothing is simulated
+        restored_accesses = (long long)(hit_cnt + miss_cnt);
+        if (stats_out &&
+            writeStats(stats_out, elapsedSince(&run_start), 1, 0))
+            exit(1);
+        printSummary(hit_cnt, miss_cnt, evict_cnt);
+        endAnalyses();
+        return 0;
+    }
+
+    /* Open the event log with a large buffer; -v gets one too */
+    if (event_log) {
+        static char event_buf[1 << 22];
+        event_fp = fopen(event_log, event_binary ? "wb" : "w");
+        if (!event_fp) {
+            fprintf(stderr, "%s: %s\n", event_log, strerror(errno));
+            exit(1);
+        }
+        setvbuf(event_fp, event_buf, _IOFBF, sizeof(event_buf));
+    } else {
+        event_binary = 0;
+    }
+    if (verbosity && !isatty(STDOUT_FILENO)) {
+        static char stdout_buf[1 << 20];
+        setvbuf(stdout, stdout_buf, _IOFBF, sizeof(stdout_buf));
+    }
+    observing = verbosity || event_fp || lifetimes || classify;
+
+    /* The filtered trace is written as it is read */
+    if (filter_out) {
+        static char filter_buf[1 << 20];
+        filter_fp = fopen(filter_out, "w");
+        if (!filter_fp) {
+            fprintf(stderr, "%s: %s\n", filter_out, strerror(errno));
+            exit(1);
+        }
+        setvbuf(filter_fp, filter_buf, _IOFBF, sizeof(filter_buf));
+    }
+    filtering = filter_ops || n_ranges || filter_fp;
+
+    dump_ts = run_start;
 
     /* Initialize cache */
     initCache();
+    if (lifetimes)
+        initLifetimes();
+
+    /* Count only the replay, not setup or output */
+    if (perf_counters)
+        perfStart();
+
+    replay(trace_file);
 
-    replayTrace(trace_file);
+    if (perf_counters)
+        perfStop();
 
     /* Free allocated memory */
     freeCache();
 
+    if (event_fp && fclose(event_fp) != 0) {
+        fprintf(stderr, "%s: %s\n", event_log, strerror(errno));
+        exit(1);
+    }
+    if (filter_fp && fclose(filter_fp) != 0) {
+        fprintf(stderr, "%s: %s\n", filter_out, strerror(errno));
+        exit(1);
+    }
+
+    if (memoize)
+        storeResult(key);
+    if (stats_out && writeStats(stats_out, elapsedSince(&run_start), 0, 0))
+        exit(1);
+
     /* Output the hit and miss statistics for the autograder */
     printSummary(hit_cnt, miss_cnt, evict_cnt);
+    endAnalyses();
+    if (profiling) {
+        profStage(PROF_OUTPUT);
+        profReport(run_start.tv_sec * 1000000000LL + run_start.tv_nsec,
+                   start_tick);
+    }
+    if (perf_counters)
+        perfReport();
     return 0;
 }
@@ -0,0 +1,339 @@
+#!/bin/sh
+#
+# run_tests.sh - Build csim and compare its output for each case in
+#     tests/cases with the expected output, then check that runs which
+#     should agree do: a restored checkpoint finishes with the counts of
+#     an uninterrupted run, and a stored result is the one a fresh run
+#     computes.
+#
+# Usage: tests/run_tests.sh [-u]
+#     -u rewrites the expected output of the cases instead of checking it.
+#
+
+cd "$(dirname "$0")" || exit 1
+tests=$(pwd)
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+
+${CC:-cc} -O2 -Wall -o "$tmp/csim" ../csim.c -lm || exit 1
+cp traces/* "$tmp"
+cd "$tmp" || exit 1
+
+update=0
+[ "$1" = "-u" ] && update=1
+failed=0
+passed=0
+
+# same <name> <expected> <actual> - The two outputs must be equal
+same() {
+    if [ "$2" = "$3" ]; then
+        passed=$((passed + 1))
+    else
+        failed=$((failed + 1))
+        echo "FAIL $1"
+        echo "  expected: $2"
+        echo "  actual:   $3"
+    fi
+}
+
+# refused <name> <csim arguments> - csim must exit with an error
+refused() {
+    name=$1
+    shift
+    if ./csim "$@" > /dev/null 2>&1; then
+        failed=$((failed + 1))
+        echo "FAIL $name: csim $* succeeded"
+    else
+        passed=$((passed + 1))
+    fi
+}
+
+# Cases with expected output
+while read -r name args; do
+    case "$name" in
+        ''|'#'*) continue ;;
+    esac
+    name=${name%:}
+    ./csim $args > "$name.out" 2>&1
+    if [ $update = 1 ]; then
+        cp "$name.out" "$tests/expected/$name.out"
+    elif cmp -s "$tests/expected/$name.out" "$name.out"; then
+        passed=$((passed + 1))
+    else
+        failed=$((failed + 1))
+        echo "FAIL $name: csim $args"
+        diff "$tests/expected/$name.out" "$name.out" | head -20
+    fi
+done < "$tests/cases"
+
+# Checkpoints: a run restored at a record ends as the full run does
+geom="-s 4 -E 2 -b 4"
+full=$(./csim $geom -t mixed.trace)
+./csim $geom -t mixed.trace --save-state mixed.ckpt --save-at 1000 > /dev/null
+same checkpoint-restore "$full" "$(./csim $geom -t mixed.trace \
+                                   --restore mixed.ckpt)"
+./csim $geom -t mixed.trace --resume resume.ckpt --checkpoint-every 500 \
+    > /dev/null
+same checkpoint-resume "$full" "$(./csim $geom -t mixed.trace \
+                                  --resume resume.ckpt)"
+refused checkpoint-other-trace $geom -t second.trace --restore mixed.ckpt
+refused checkpoint-other-geometry -s 3 -E 2 -b 4 -t mixed.trace \
+    --restore mixed.ckpt
+
+bin="-s 5 -E 4 -b 5 -t bin.drm --trace-format drmemtrace"
+full=$(./csim $bin)
+./csim $bin --save-state bin.ckpt --save-at 300 > /dev/null
+same checkpoint-restore-binary "$full" "$(./csim $bin --restore bin.ckpt)"
+
+# Seeking: --index and the trace cache change speed, not results
+window=$(./csim $geom -t mixed.trace --skip 1000 --limit 1500)
+same index "$window" "$(./csim $geom -t mixed.trace --skip 1000 \
+                        --limit 1500 --index)"
+bin="-s 5 -E 4 -b 5 --skip 100 --limit 300"
+same raw-window "$(./csim $bin -t bin.trace)" \
+     "$(./csim $bin -t bin.raw --trace-format raw)"
+same champsim-thread "$(./csim $bin --cat 0x1:t0 -t bin.raw --trace-format raw)" \
+     "$(./csim $bin --cat 0x1:t0 -t bin.champ --trace-format champsim)"
+mkdir cache
+./csim $geom -t mixed.trace --trace-cache cache > /dev/null
+same trace-cache "$(./csim $geom -t mixed.trace)" \
+     "$(./csim $geom -t mixed.trace --trace-cache cache)"
+# a size limit evicts the least recently used copies
+for t in mixed second bin; do
+    mkdir ref.$t
+    ./csim $geom -t $t.trace --trace-cache ref.$t > /dev/null
+done
+max=$(($(cat ref.mixed/* | wc -c) + $(cat ref.second/* | wc -c)))
+lru="$geom --trace-cache lru --trace-cache-max $max"
+mkdir lru
+for t in second mixed bin; do
+    ./csim $lru -t $t.trace > /dev/null
+done
+same trace-cache-evict "$(ls ref.mixed ref.bin | grep ctrace | sort)" \
+     "$(ls lru | sort)"
+for t in mixed second; do
+    ./csim $lru -t $t.trace > /dev/null
+done
+same trace-cache-lru "$(ls ref.mixed ref.second | grep ctrace | sort)" \
+     "$(ls lru | sort)"
+
+# Diffs: refuse what they cannot honor, and flag runs set up differently
+refused diff-cat $geom -t mixed.trace --diff second.trace --cat 0x1
+refused diff-verbose $geom -t mixed.trace --diff second.trace -v
+refused diff-stats-out $geom -t mixed.trace --diff second.trace \
+    --stats-out diff.json
+z='\000\000\000\000\000\000'
+printf "\173\001$z\002\000$z" > brace2.raw
+printf "\173\001$z\002\000$z\003\100$z" > brace3.raw
+same diff-raw-brace "diff: total                            misses:2 -> 3 (+1)" \
+     "$(./csim -s 2 -E 1 -b 2 -t brace2.raw --trace-format raw \
+        --diff brace3.raw | grep total | cut -c1-57)"
+./csim $geom -t mixed.trace --stats-out lru.json > /dev/null
+./csim $geom -t mixed.trace --policy lip --stats-out lip.json > /dev/null
+same diff-stats-policy "diff: warning: config.policy differs (lip vs lru)" \
+     "$(./csim $geom --diff lru.json -t lip.json | grep config.policy)"
+refused diff-stats-trace $geom --diff lru.json -t mixed.trace
+
+# Filtered traces keep the pcs that SHiP and Hawkeye predict from
+ship="-s 4 -E 4 -b 6 --policy ship"
+./csim $ship -t loop.trace --ops LSM --filter-out loop.out > /dev/null
+same filter-out-pc "$(./csim $ship -t loop.trace)" \
+     "$(./csim $ship -t loop.out)"
+drm="-s 5 -E 4 -b 5 --policy hawkeye"
+./csim $drm -t bin.drm --trace-format drmemtrace --filter-out drm.out \
+    > /dev/null
+same filter-out-pc-binary \
+     "$(./csim $drm -t bin.drm --trace-format drmemtrace)" \
+     "$(./csim $drm -t drm.out)"
+
+# SIGUSR1 snapshots a run without stopping it, in every mode. The trace
+# is a pipe, so the signal arrives while the run waits for its records.
+raw="-s 5 -E 4 -b 5 --trace-format raw"
+mkfifo pipe.raw
+./csim $raw -t pipe.raw --dump-file snap.json > usr1.out &
+pid=$!
+exec 3> pipe.raw
+kill -USR1 $pid
+cat bin.raw >&3
+exec 3>&-
+wait $pid
+same sigusr1-run "0 $(./csim $raw -t bin.raw)" "$? $(cat usr1.out)"
+grep -q '"interval"' snap.json
+same sigusr1-snapshot 0 $?
+./csim $raw -t pipe.raw --diff bin.raw > /dev/null &
+pid=$!
+exec 3> pipe.raw
+kill -USR1 $pid
+cat bin.raw >&3
+exec 3>&-
+wait $pid
+same sigusr1-diff 0 $?
+
+# --progress reports on stderr while the run waits for its records
+./csim $raw -t pipe.raw --progress=1 > progress.out 2> progress.err &
+pid=$!
+exec 3> pipe.raw
+head -c 800 bin.raw >&3
+sleep 2
+tail -c +801 bin.raw >&3
+exec 3>&-
+wait $pid
+same progress-run "0 $(./csim $raw -t bin.raw)" "$? $(cat progress.out)"
+grep -Eq '^progress: .*% .* records .* records/s .*miss rate .*ETA' \
+    progress.err
+same progress-report 0 $?
+
+# A way mask covers at most 64 ways
+refused cat-wide -s 2 -E 80 -b 4 -t mixed.trace --cat 0x3
+
+# Results store: a stored result is returned only for the same run
+fresh=$(./csim $geom -t mixed.trace --results-store results)
+same results-store "$fresh" "$(./csim $geom -t mixed.trace \
+                               --results-store results)"
+cat="-s 4 -E 4 -b 4 -t mixed.trace"
+./csim $cat --cat 0x1:s0 --results-store results > /dev/null
+same results-store-cat-source "$(./csim $cat --cat 0x1:s1 | head -1)" \
+     "$(./csim $cat --cat 0x1:s1 --results-store results | head -1)"
+corun="$cat --corun second.trace"
+./csim $corun --interleave rr:2 --results-store results > /dev/null
+same results-store-interleave "$(./csim $corun --interleave rr:3 | head -1)" \
+     "$(./csim $corun --interleave rr:3 --results-store results | head -1)"
+stats="$corun --cat 0x3:s0 --cat 0xc:s1 --ops LS --results-store results"
+./csim $stats --stats-out fresh.json > fresh.out
+./csim $stats --stats-out memoized.json > memoized.out
+same results-store-report "$(cat fresh.out)" "$(cat memoized.out)"
+same results-store-stats \
+     "$(grep -Ev 'seconds|per_sec|memoized|pid' fresh.json)" \
+     "$(grep -Ev 'seconds|per_sec|memoized|pid' memoized.json)"
+grep -q '"memoized": true' memoized.json
+same results-store-memoized 0 $?
+control="-s 2 -E 2 -b 4 -t control.trace --results-store results"
+same results-store-control "$(./csim $control)" "$(./csim $control)"
+sweep="$cat --cat 0x1:0-1000 --cat 0x1:1000-40000 --cat-sweep"
+./csim $sweep --results-store sweep.store > /dev/null
+same results-store-sweep "$(./csim $sweep)" \
+     "$(./csim $sweep --results-store sweep.store)"
+same results-store-sweep-points 3 $(grep -vc '^trace ' sweep.store)
+# the store keeps the trace hashes; no index is written without --index
+same results-store-no-index "" "$(ls second.trace.idx 2> /dev/null)"
+
+# Traces of the same size that differ past the first and last 64 KiB
+for i in 1 2 3 4 5 6 7 8 9 10; do cat mixed.trace; done > big.trace
+awk '{ if (pos >= 80000 && pos < 85000) sub(/^ L/, " M"); print
+       pos += length($0) + 1 }' big.trace > big2.trace
+./csim $geom -t big.trace --results-store results > /dev/null
+same results-store-content "$(./csim $geom -t big2.trace)" \
+     "$(./csim $geom -t big2.trace --results-store results)"
+
+# Self-profiling reports the stages and rates without changing the result
+./csim $geom -t mixed.trace --profile > profile.out
+same profile-summary "$(./csim $geom -t mixed.trace)" "$(head -1 profile.out)"
+same profile-stages "profile wall io parse access output other" \
+     "$(sed -n 2p profile.out | sed 's/:[^ ]*//g')"
+same profile-counts "records:3000 accesses:4028" \
+     "$(grep -o 'records:[0-9]* accesses:[0-9]*' profile.out)"
+
+# Host counters are reported, as n/a where the host has none, and do not
+# change the result
+./csim $geom -t mixed.trace --perf-counters > perf.out
+same perf-counters-run 0 $?
+same perf-counters-summary "$(./csim $geom -t mixed.trace)" \
+     "$(head -1 perf.out)"
+same perf-counters-events \
+     "perf cycles instructions llc-misses dtlb-misses branch-misses" \
+     "$(grep '^perf: cycles' perf.out | sed 's/:[^ ]*//g')"
+
+# Generators are deterministic for a seed, and the benchmark simulates
+# the traces they write
+same gen-seq "$(printf ' L 0,8\n L 8,8\n L 10,8\n S 18,8')" \
+     "$(./csim --gen seq --gen-length 4)"
+same gen-seed "$(./csim --gen random --gen-length 50 --seed 7)" \
+     "$(./csim --gen random --gen-length 50 --seed 7)"
+[ "$(./csim --gen random --gen-length 50 --seed 7)" != \
+  "$(./csim --gen random --gen-length 50 --seed 8)" ]
+same gen-seed-differs 0 $?
+refused gen-kind --gen bogus --gen-length 10
+./csim $geom --bench --bench-accesses 2000 --bench-reps 3 \
+    --bench-out bench.json > bench.out
+kinds="seq stride random zipf chase transpose"
+same bench-kinds "$kinds" "$(echo $(awk '{ print $2 }' bench.out))"
+for kind in $kinds; do
+    ./csim --gen $kind --gen-length 2000 > $kind.trace
+    same bench-$kind "$(./csim $geom -t $kind.trace)" \
+         "$(grep "\"bench\":\"$kind\"" bench.json |
+            sed -e 's/.*"hits":/hits:/' -e 's/,"misses":/ misses:/' \
+                -e 's/,"evictions":/ evictions:/' -e 's/}$//')"
+done
+
+# A baseline flags the benchmarks that got slower, and only on its host
+bench="$geom --bench --bench-accesses 2000 --bench-reps 3"
+./csim $bench --bench-baseline base.txt --bench-save-baseline > /dev/null
+same bench-baseline-saved 6 $(wc -l < base.txt)
+awk '{ $7 = 1; print }' base.txt > slow.txt
+./csim $bench --bench-baseline slow.txt > bench.out
+same bench-baseline-faster "0 0" "$? $(grep -c REGRESSION bench.out)"
+awk '{ $7 = 1000000000000; print }' base.txt > fast.txt
+./csim $bench --bench-baseline fast.txt > bench.out
+same bench-baseline-slower "2 6" "$? $(grep -c REGRESSION bench.out)"
+awk '{ $1 = "0"; $7 = 1000000000000; print }' base.txt > other.txt
+./csim $bench --bench-baseline other.txt > bench.out
+same bench-baseline-other-host "0 0" "$? $(grep -c baseline bench.out)"
+
+# The event log holds one event per access, in text or binary form
+./csim $geom -t mixed.trace --event-log events.txt > events.out
+same event-log-summary "$(./csim $geom -t mixed.trace)" "$(cat events.out)"
+same event-log-outcomes "H:1154 M:32 E:2842" \
+     "$(echo $(for r in H M E; do
+                   echo "$r:$(awk -v r=$r '$4 == r' events.txt | wc -l)"
+               done))"
+./csim $geom -t mixed.trace --event-log events.bin --event-format bin \
+    > /dev/null
+same event-log-bin-size $((4028 * 24)) $(wc -c < events.bin)
+# the result byte of each 24-byte record: 1 hit, 2 miss, 6 miss eviction
+same event-log-bin "$(awk '{ print $4 }' events.txt)" \
+     "$(od -An -v -tu1 -w24 events.bin |
+        awk '{ print $22 == 1 ? "H" : $22 == 6 ? "E" : "M" }')"
+
+# --interleave time merges drmemtrace co-runs in timestamp order
+z7='\000\000\000\000\000\000\000'
+ts() { printf "\034\000\002\000\\$1$z7"; }
+load() { printf "\000\000\010\000\\$1\\$2${z7#????}"; }
+{ ts 001; load 000 000; ts 003; load 100 000; } > early.drm
+{ ts 002; load 000 020; ts 004; load 100 020; } > late.drm
+{ ts 000; load 000 020; ts 000; load 100 020; } > first.drm
+time="-s 4 -E 4 -b 4 --trace-format drmemtrace --interleave time"
+./csim $time -t early.drm --corun late.drm --event-log time.txt > /dev/null
+same interleave-time "0 1000 40 1040" "$(echo $(awk '{ print $2 }' time.txt))"
+./csim $time -t early.drm --corun first.drm --event-log time.txt > /dev/null
+same interleave-time-first "1000 1040 0 40" \
+     "$(echo $(awk '{ print $2 }' time.txt))"
+
+# --stats-out writes the run's counters as JSON or as one CSV row
+./csim $geom -t mixed.trace --stats-out stats.json > /dev/null
+same stats-json "1154 2874 2842" \
+     "$(echo $(grep -E '"(hits|misses|evictions)":' stats.json |
+               sed 's/.*: \([0-9]*\).*/\1/'))"
+./csim $geom -t mixed.trace --stats-out stats.csv --format csv > /dev/null
+same stats-csv-rows 2 $(wc -l < stats.csv)
+same stats-csv-columns "$(head -1 stats.csv | awk -F, '{ print NF }')" \
+     "$(tail -1 stats.csv | awk -F, '{ print NF }')"
+same stats-csv "1154 2874 2842" \
+     "$(echo $(for f in hits misses evictions; do
+                   awk -F, -v f=counters_$f '
+                       NR == 1 { for (i = 1; i <= NF; i++) if ($i == f) k = i }
+                       NR == 2 { print $k }' stats.csv
+               done))"
+
+# Reuse profiles: a generated trace follows the profile, and only a
+# profile of this version is read
+./csim $geom -t mixed.trace --reuse-profile mixed.prof > /dev/null
+same reuse-profile-header "csim-reuse-profile 1" "$(head -1 mixed.prof)"
+./csim --gen-profile mixed.prof --gen-length 2000 > gen.trace
+same gen-profile-length 2000 $(wc -l < gen.trace)
+same gen-profile-ops LMS "$(cut -c2 gen.trace | sort -u | tr -d '\n')"
+refused gen-profile-kind --gen-profile mixed.trace --gen-length 10
+sed '1s/ 1$/ 9/' mixed.prof > future.prof
+refused gen-profile-version --gen-profile future.prof --gen-length 10
+
+echo "$passed passed, $failed failed"
+[ $failed = 0 ]